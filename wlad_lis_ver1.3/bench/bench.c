@@ -0,0 +1,419 @@
+/* Cycle count benchmarks of the wireless LAD firmware in the simulator of mspdebug
+ *
+ * Built with msp430-gcc together with main.c, see msp430_bench.h. main() below takes the place of the firmware main():
+ * it initialises the node as the firmware does, runs the hot paths one at a time and stops at the breakpoint set on
+ * bench_done(). Each measurement reads TA1R before and after the code under test and subtracts the cycles of an empty
+ * measurement. The results are left as CSV lines "kind,name,cycles" in bench_report, which the Makefile dumps:
+ *  function	call of a function, CALL and RET included, without the flash erase emulation
+ *  stall		cycles the flash timing generator would hold the CPU in the function before it
+ *  isr			interrupt service routine from the interrupt request to the end of RETI
+ *  command		ASCII frame from its first character to the last character of its acknowledgement: the receive
+ *				interrupts, the EVENT_UART_FRAME handler and the transmit interrupts
+ *  latency		masked_worst, the longest code run by main with interrupts disabled, and interrupt_worst, the worst case
+ *				time from an interrupt request to its routine: the longest routine or masked code before it, the longest
+ *				instruction and the interrupt entry
+ * The transmitter is taken to be always ready, so the time characters take on the line is not included.
+ */
+
+#ifdef BENCH_BUILD
+
+#define BENCH_HARNESS
+#include "hal.h"
+
+#define BENCH_ENTRY_CYCLES				6											// Interrupt request to the first instruction of the routine
+#define BENCH_RETI_CYCLES				5
+#define BENCH_LONGEST_INSTRUCTION		6											// Cycles an interrupt request may wait for the instruction in progress
+#define BENCH_FLASH_DIVIDER				24											// FN bits of FCTL2 set by FLASH_INIT(), plus one
+#define BENCH_FLASH_ERASE				(4819UL * BENCH_FLASH_DIVIDER)				// Segment erase in MCLK cycles
+#define BENCH_FLASH_WRITE				(30UL * BENCH_FLASH_DIVIDER)				// Byte write in MCLK cycles
+#define BENCH_INFO_SEGMENT				64
+#define BENCH_MAIN_START				0xC000
+#define BENCH_MAIN_SEGMENT				512
+#define BENCH_FLASH_COMMITS				16											// flash_write() runs, enough to rotate the configuration log
+#define BENCH_GROUP_ADDRESS				0xFE										// Broadcast
+
+/* Enters an interrupt service routine as the CPU does, return address and SR on the stack for its RETI */
+#define BENCH_INTERRUPT(routine)		__asm__ __volatile__ ("push #1f\n\tpush r2\n\tbr #" #routine "\n1:" : : : "memory")
+
+/* Measures a statement, then lets the transmitter send what it queued */
+#define BENCH(name, statement)			{ bench_begin(); statement; bench_result("function", name, bench_end()); bench_drain(); }
+#define BENCH_ISR(name, routine)		{ bench_begin(); BENCH_INTERRUPT(routine); bench_isr(name, bench_end()); }
+
+/* Firmware under test, see main.c */
+extern unsigned char received_val[8];
+extern unsigned char character_count;
+extern unsigned int command_index_match;
+extern volatile unsigned char pending_events;
+extern unsigned int sensing_freq;
+extern volatile unsigned char minute_checkpoints;
+extern unsigned char minute_interval;
+extern unsigned int fade_periods;
+extern volatile unsigned char pir_samples;
+extern unsigned char pir_high_count;
+extern unsigned char pir_window;
+extern volatile unsigned int pir_warm_up;
+
+unsigned char find_command();
+void dispatch_command();
+void handle_uart_frames();
+void handle_dimming();
+void handle_minute();
+void set_duty_cycle(unsigned int Percentage_val);
+void print_val1(unsigned int Value, unsigned int polling_host);
+void print_setting();
+void print_address(unsigned int isHostAddress);
+void print_command(int lis_value);
+void flash_write();
+void UART_INIT();
+void FLASH_INIT();
+void TIMER_INIT();
+void PORT_OUT_INIT();
+void SYS_INIT();
+
+__interrupt void USCI0RX_ISR(void);
+__interrupt void USCI0TX_ISR(void);
+__interrupt void Timer_A(void);
+__interrupt void Checkpoint_timer(void);
+__interrupt void Supply_sag(void);
+__interrupt void Timer_A2(void);
+__interrupt void Timer_A1(void);
+__interrupt void Port_1(void);
+
+extern char bench_report[];														// At BENCH_REPORT, see Makefile
+
+static unsigned int empty_routine;												// Cycles of a routine with nothing but RETI
+static unsigned int isr_max;													// Longest routine from request to RETI
+static unsigned int report_length;
+static volatile unsigned char found;
+
+/* Nothing but RETI, the measurement of every routine is taken relative to it */
+__interrupt void bench_empty_routine(void)
+{
+}
+
+/* The breakpoint of the Makefile, all results are in bench_report */
+__attribute__((noinline)) void bench_done(void)
+{
+	__asm__ __volatile__ ("nop");
+}
+
+__attribute__((noinline)) static void bench_begin(void)
+{
+	bench.excluded = 0;
+	TA1CTL &= ~TAIFG;
+	bench.start = TA1R;
+}
+
+/* Cycles since bench_begin(), right up to 131071 */
+__attribute__((noinline)) static unsigned long bench_end(void)
+{
+	unsigned int stop = TA1R;
+	unsigned long cycles = (unsigned int) (stop - bench.start);
+
+	if((TA1CTL & TAIFG) && (stop >= bench.start))
+	{
+		cycles += 0x10000UL;
+	}
+	return cycles - bench.excluded - bench.overhead;
+}
+
+static void bench_print(const char *text, unsigned char length)
+{
+	while(length-- && *text)
+	{
+		bench_report[report_length++] = *text++;
+	}
+	bench_report[report_length] = 0;
+}
+
+/* Appends "kind,name,cycles" to bench_report */
+static void bench_result(const char *kind, const char *name, unsigned long cycles)
+{
+	char digits[10];
+	unsigned char count = 0;
+
+	do
+	{
+		digits[count++] = '0' + (cycles % 10);
+		cycles /= 10;
+	}
+	while(cycles != 0);
+
+	bench_print(kind, 0xFF);
+	bench_print(",", 1);
+	bench_print(name, 0xFF);
+	bench_print(",", 1);
+	while(count != 0)
+	{
+		bench_print(&digits[--count], 1);
+	}
+	bench_print("\n", 1);
+}
+
+/* Reports a routine measured by BENCH_ISR from the interrupt request to the end of its RETI */
+static void bench_isr(const char *name, unsigned long cycles)
+{
+	cycles = cycles - empty_routine + BENCH_ENTRY_CYCLES + BENCH_RETI_CYCLES;
+	if(cycles > isr_max)
+	{
+		isr_max = cycles;
+	}
+	bench_result("isr", name, cycles);
+}
+
+/* Reports the flash timing generator time of the flash operations counted since bench_flash_clear() */
+static void bench_stall(const char *name)
+{
+	bench_result("stall", name, (bench.flash_erases * BENCH_FLASH_ERASE) + (bench.flash_writes * BENCH_FLASH_WRITE));
+}
+
+static void bench_flash_clear(void)
+{
+	bench.flash_erases = 0;
+	bench.flash_writes = 0;
+}
+
+/* Sends every queued character and forgets the events posted */
+static void bench_drain(void)
+{
+	while(IE2 & UCA0TXIE)
+	{
+		BENCH_INTERRUPT(USCI0TX_ISR);
+	}
+	pending_events = 0;
+}
+
+/* Leaves a frame in received_val as handle_uart_frames() does */
+static void bench_frame(const char *opcode)
+{
+	unsigned char index;
+
+	for(index = 0; index < 7; index++)
+	{
+		received_val[index] = opcode[index];
+	}
+	received_val[7] = BENCH_GROUP_ADDRESS;
+	command_index_match = 255;													// Not a repeated command
+}
+
+/* Receives a seven character ASCII frame and measures it up to the end of its acknowledgement */
+static void bench_command(const char *opcode)
+{
+	unsigned char index;
+
+	command_index_match = 255;
+	bench_begin();
+	for(index = 0; index < 8; index++)
+	{
+		UCA0RXBUF = (index < 7) ? opcode[index] : BENCH_GROUP_ADDRESS;
+		BENCH_INTERRUPT(USCI0RX_ISR);
+	}
+	handle_uart_frames();
+	while(IE2 & UCA0TXIE)
+	{
+		BENCH_INTERRUPT(USCI0TX_ISR);
+	}
+	bench_result("command", opcode, bench_end());
+	bench_drain();
+}
+
+/* Receives characters outside of any measurement */
+static void bench_receive(const char *text)
+{
+	while(*text)
+	{
+		UCA0RXBUF = *text++;
+		BENCH_INTERRUPT(USCI0RX_ISR);
+	}
+}
+
+void bench_mask(void)
+{
+	if(bench.masked == 0)
+	{
+		bench.masked = 1;
+		bench.masked_start = TA1R;
+	}
+}
+
+void bench_unmask(void)
+{
+	unsigned int cycles = TA1R - bench.masked_start;
+
+	if((bench.masked != 0) && (cycles > bench.masked_max))
+	{
+		bench.masked_max = cycles;
+	}
+	bench.masked = 0;
+}
+
+/* Segment erase of the flash controller, left out of the measurement */
+void bench_flash_erase(unsigned char *pointer)
+{
+	unsigned int start = TA1R;
+	unsigned int size = ((unsigned int) pointer < BENCH_MAIN_START) ? BENCH_INFO_SEGMENT : BENCH_MAIN_SEGMENT;
+	unsigned char *byte = (unsigned char *) ((unsigned int) pointer & ~(size - 1));
+
+	while(size--)
+	{
+		*byte++ = 0xFF;
+	}
+	bench.flash_erases++;
+	bench.excluded += (unsigned int) (TA1R - start);
+}
+
+/* The transmitter is always ready, so a HAL_WAIT() loop sends the next queued character */
+void bench_wait(void)
+{
+	if(IE2 & UCA0TXIE)
+	{
+		BENCH_INTERRUPT(USCI0TX_ISR);
+	}
+}
+
+static void bench_functions(void)
+{
+	unsigned char run;
+	unsigned long cycles;
+	unsigned long worst = 0;
+	unsigned int erases = 0;
+	unsigned int writes = 0;
+
+	bench_frame("ADSPL50");
+	BENCH("find_command/hit", found = find_command());
+	bench_frame("ADXYZ00");
+	BENCH("find_command/miss", found = find_command());
+	bench_frame("ADSPL50");
+	BENCH("dispatch_command/ADSPL50", dispatch_command());
+	bench_frame("ADGSSET");
+	BENCH("dispatch_command/ADGSSET", dispatch_command());
+
+	BENCH("set_duty_cycle/0", set_duty_cycle(0));
+	BENCH("set_duty_cycle/50", set_duty_cycle(50));
+	BENCH("handle_dimming/fade", handle_dimming());
+	BENCH("set_duty_cycle/99", set_duty_cycle(99));
+
+	BENCH("print_val1", print_val1(42, 0));
+	BENCH("print_setting", print_setting());
+	BENCH("print_address", print_address(0));
+	BENCH("print_command", print_command(1));
+
+	minute_checkpoints = minute_interval;
+	BENCH("handle_minute", handle_minute());
+
+	/* Every commit changes a setting, the worst one rotates the configuration log */
+	for(run = 0; run < BENCH_FLASH_COMMITS; run++)
+	{
+		sensing_freq = 10 + run;
+		bench_flash_clear();
+		bench_begin();
+		flash_write();
+		cycles = bench_end();
+		if(run == 0)
+		{
+			bench_result("function", "flash_write/append", cycles);
+			bench_stall("flash_write/append");
+		}
+		if(cycles > worst)
+		{
+			worst 	= cycles;
+			erases 	= bench.flash_erases;
+			writes 	= bench.flash_writes;
+		}
+	}
+	bench.flash_erases 	= erases;
+	bench.flash_writes 	= writes;
+	bench_result("function", "flash_write/worst", worst);
+	bench_stall("flash_write/worst");
+}
+
+static void bench_isrs(void)
+{
+	character_count = 0;
+	UCA0RXBUF = 'A';
+	BENCH_ISR("USCI0RX_ISR/character", USCI0RX_ISR);
+	bench_receive("DSPL50");
+	UCA0RXBUF = BENCH_GROUP_ADDRESS;
+	BENCH_ISR("USCI0RX_ISR/frame", USCI0RX_ISR);
+	handle_uart_frames();
+	bench_drain();
+
+	print_val1(42, 0);
+	BENCH_ISR("USCI0TX_ISR", USCI0TX_ISR);
+	bench_drain();
+
+	set_duty_cycle(0);
+	handle_dimming();
+	BENCH_ISR("Timer_A/fade_step", Timer_A);
+	fade_periods = 1;
+	BENCH_ISR("Timer_A/fade_end", Timer_A);
+
+	minute_checkpoints = minute_interval - 1;
+	BENCH_ISR("Checkpoint_timer/minute", Checkpoint_timer);
+	BENCH_ISR("Supply_sag", Supply_sag);
+
+	bench_receive("AD");
+	BENCH_ISR("Timer_A2/gap", Timer_A2);
+
+	pir_samples 	= pir_window;
+	pir_high_count 	= 0;
+	TA1IV 			= 4;														// Plain memory in the simulator, CCR2
+	BENCH_ISR("Timer_A1/pir_sample", Timer_A1);
+
+	pir_samples 	= 0;
+	pir_warm_up 	= 0;
+	P1IFG 			= BIT5;
+	BENCH_ISR("Port_1/pir_edge", Port_1);
+	bench_drain();
+}
+
+static void bench_commands(void)
+{
+	bench_command("ADSPL50");
+	bench_command("ADGSSET");
+	bench_command("ADGTSN3");
+	bench_command("ADGNOGP");
+	bench_command("ADWRFLS");
+}
+
+int main(void)
+{
+	unsigned int cycles;
+
+	WDTCTL = WDTPW | WDTHOLD;
+	TA1CTL = TASSEL_2 + MC_2 + TACLR;											// Timer1 counts MCLK cycles, also in the simulator
+	bench.overhead 		= 0;
+	bench.masked 		= 0;
+	bench.masked_max 	= 0;
+	bench_begin();
+	bench.overhead 		= bench_end();
+	bench_begin();
+	BENCH_INTERRUPT(bench_empty_routine);
+	empty_routine 		= bench_end();
+
+	/* Blank configuration log and table log, as on a new node */
+	bench_flash_erase((unsigned char *) 0x1000);
+	bench_flash_erase((unsigned char *) 0x1040);
+	bench_flash_erase((unsigned char *) 0x1080);
+	bench_flash_erase((unsigned char *) BENCH_MAIN_START);
+	bench_flash_erase((unsigned char *) (BENCH_MAIN_START + BENCH_MAIN_SEGMENT));
+
+	UART_INIT();
+	FLASH_INIT();
+	TIMER_INIT();
+	PORT_OUT_INIT();
+	SYS_INIT();
+	bench_drain();
+
+	bench_functions();
+	bench_isrs();
+	bench_commands();
+
+	cycles = (bench.masked_max > isr_max) ? bench.masked_max : isr_max;
+	bench_result("latency", "masked_worst", bench.masked_max);
+	bench_result("latency", "interrupt_worst", cycles + BENCH_LONGEST_INSTRUCTION + BENCH_ENTRY_CYCLES);
+	bench_done();
+	return 0;
+}
+
+#endif /* BENCH_BUILD */
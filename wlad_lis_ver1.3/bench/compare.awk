@@ -0,0 +1,44 @@
+# Compares two result files of bench.c, "kind,name,cycles" per line: the baseline first, then the new results.
+# Exits with 1 when a benchmark takes more than LIMIT percent cycles over the baseline, or is missing from the results.
+
+NR == FNR {
+	baseline[$1 "," $2] = $3;
+	next;
+}
+
+{
+	key = $1 "," $2;
+	seen[key] = 1;
+	if(key in baseline)
+	{
+		change = $3 - baseline[key];
+		percent = (baseline[key] != 0) ? (100.0 * change / baseline[key]) : 0;
+		printf("%-8s %-28s %8d %8d %+8d %+7.1f%%%s\n", $1, $2, baseline[key], $3, change, percent,
+				(percent > LIMIT) ? "  slower" : "");
+		if(percent > LIMIT)
+		{
+			slower++;
+		}
+	}
+	else
+	{
+		printf("%-8s %-28s %8s %8d\n", $1, $2, "-", $3);
+	}
+}
+
+END {
+	for(key in baseline)
+	{
+		if(!(key in seen))
+		{
+			split(key, part, ",");
+			printf("%-8s %-28s %8d %8s  missing\n", part[1], part[2], baseline[key], "-");
+			missing++;
+		}
+	}
+	if(slower + missing > 0)
+	{
+		printf("%d slower than %s%% over the baseline, %d missing\n", slower, LIMIT, missing);
+		exit 1;
+	}
+}
@@ -0,0 +1,59 @@
+/* Benchmark build of the wireless LAD firmware: msp430-gcc, run by bench.c in the simulator of mspdebug
+ *
+ * The simulator counts the MCLK cycles of every instruction and clocks its Timer_A model at Timer1 with them, so TA1R
+ * counts cycles just as it does for event_max_cycles on the target. The HAL macros are the register accesses of the
+ * target, except that flash erases are emulated, which the simulator does not do, and counted together with the bytes
+ * written, so that bench.c can add the time the flash timing generator would hold the CPU. A HAL_WAIT() loop lets the
+ * transmitter take the next queued character.
+ *
+ * Interrupts stay disabled for the whole run, bench.c enters the interrupt service routines itself. __disable_interrupt()
+ * and __enable_interrupt() of main.c only time the code they enclose for the worst case interrupt latency.
+ */
+
+#ifndef MSP430_BENCH_H_
+#define MSP430_BENCH_H_
+
+#include <msp430.h>
+
+/* msp430-gcc ignores the vector pragma, bench.c enters the routines through a simulated interrupt */
+#define __interrupt						__attribute__((interrupt))
+
+#undef __disable_interrupt
+#undef __enable_interrupt
+#define __disable_interrupt()			bench_mask()
+#define __enable_interrupt()			bench_unmask()
+
+/* HAL, see hal.h */
+#define HAL_UART_SEND(character)			(UCA0TXBUF = (character))
+#define HAL_UART_RECEIVE()					(UCA0RXBUF)
+#define HAL_FLASH(address)					((unsigned char *) (address))
+#define HAL_FLASH_ERASE(pointer)			bench_flash_erase(pointer)
+#define HAL_FLASH_WRITE(pointer, value)		(*(pointer) = (value), bench.flash_writes++)
+#define HAL_WAIT()							bench_wait()
+
+/* State of the harness, kept in the vacant address space after the RAM so that the firmware has all 512 bytes */
+struct bench_state
+{
+	unsigned int start;												// TA1R at the start of the measurement
+	unsigned int overhead;											// Cycles of an empty measurement
+	unsigned long excluded;											// Cycles of the flash emulation in the running measurement
+	unsigned int flash_erases;										// Segment erases since the last bench_flash_clear()
+	unsigned int flash_writes;										// Bytes written since the last bench_flash_clear()
+	unsigned char masked;											// Inside __disable_interrupt()
+	unsigned int masked_start;										// TA1R at __disable_interrupt()
+	unsigned int masked_max;										// Longest masked code seen
+};
+
+extern struct bench_state bench;									// At BENCH_STATE, see Makefile
+
+void bench_mask(void);
+void bench_unmask(void);
+void bench_flash_erase(unsigned char *pointer);
+void bench_wait(void);
+
+/* The firmware main() is never started, bench.c runs the code under test by itself */
+#ifndef BENCH_HARNESS
+#define main							firmware_main
+#endif
+
+#endif /* MSP430_BENCH_H_ */
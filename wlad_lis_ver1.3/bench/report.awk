@@ -0,0 +1,22 @@
+# Turns the md dump of bench_report by mspdebug back into its text, up to the terminating 0
+#     00440: 66 75 6e 63 74 69 6f 6e 2c 66 69 6e 64 5f 63 6f |function,find_co|
+
+BEGIN {
+	for(value = 0; value < 256; value++)
+	{
+		byte[sprintf("%02x", value)] = value;
+	}
+}
+
+done == 0 && $1 ~ /^[0-9a-fA-F]+:$/ {
+	for(field = 2; field <= NF && $field !~ /^\|/; field++)
+	{
+		value = byte[tolower($field)];
+		if(value == 0)
+		{
+			done = 1;
+			break;
+		}
+		printf("%c", value);
+	}
+}
@@ -0,0 +1,41 @@
+/* Hardware abstraction layer of the wireless LAD firmware
+ *
+ * main.c reaches the peripherals through the macros below wherever an access has a side effect that a simulation has to
+ * see: UART data, flash erase and programming, flash reads and the polling loops that wait for an interrupt or a flag.
+ * Configuration registers, GPIO, the timers and ADC10 are used by their register names, so this is not a full
+ * abstraction of the peripherals: host/msp430_host.h simulates those as plain variables that hal_host.c reads and sets.
+ * On the MSP430 every macro is the register access or statement it replaces, so the code generated is the same as before.
+ *
+ * Built with HOST_BUILD defined, host/msp430_host.h provides the same register names as variables, the intrinsics as
+ * functions and these macros on top of the simulated peripherals in host/hal_host.c, so the whole firmware runs as a
+ * Linux executable in simulated time. See host/Makefile.
+ *
+ * Built with BENCH_BUILD defined, bench/msp430_bench.h builds the firmware with msp430-gcc for the cycle count benchmarks
+ * run in the simulator of mspdebug. See bench/Makefile.
+ */
+
+#ifndef HAL_H_
+#define HAL_H_
+
+#ifdef HOST_BUILD
+
+#include "host/msp430_host.h"
+
+#elif defined(BENCH_BUILD)
+
+#include "bench/msp430_bench.h"
+
+#else
+
+#include <msp430g2553.h>
+
+#define HAL_UART_SEND(character)			(UCA0TXBUF = (character))				// Clears UCA0TXIFG
+#define HAL_UART_RECEIVE()					(UCA0RXBUF)								// Clears UCA0RXIFG
+#define HAL_FLASH(address)					((unsigned char *) (address))			// Flash byte at an address of the memory map
+#define HAL_FLASH_ERASE(pointer)			(*(pointer) = 0)						// Dummy write with ERASE set
+#define HAL_FLASH_WRITE(pointer, value)		(*(pointer) = (value))					// Byte write with WRT set
+#define HAL_WAIT()																	// Body of a loop polling a flag set by the hardware
+
+#endif
+
+#endif /* HAL_H_ */
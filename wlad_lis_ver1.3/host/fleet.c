@@ -0,0 +1,676 @@
+/* Fleet simulation of the wireless LAD firmware: many nodes behind a modeled BLE bridge
+ *
+ * Every node runs main.c unchanged on the peripherals of hal_host.c, built with HOST_FLEET. The firmware keeps its state
+ * in globals, so each node has a coroutine with a stack of its own and an image of the state of main.c and hal_host.c,
+ * which the Makefile collects in the sections wlad_data and wlad_bss. The image of a node is copied in before it runs and
+ * back out when another node runs. A discrete event loop takes, in time order, the wake ups the nodes ask for through
+ * fleet_yield(), the script steps and the radio.
+ *
+ * The BLE bridge model has one radio channel shared by the gateway and all nodes, with pure ALOHA access: transmissions
+ * that overlap in time collide and are lost. Every packet takes the overhead and its bytes at the bit rate on the air.
+ *  - A gateway frame leaves the bridge after the bridge latency and is broadcast once. Every node gets it after a random
+ *    delay up to the jitter, the relaying of the mesh, unless the loss drops it for that node.
+ *  - A node frame, the characters sent up to \r, is sent by its BLE module after a random access delay up to the jitter,
+ *    is dropped with the loss probability and reaches the gateway after the bridge latency. The address request "p\r" is
+ *    answered by the module itself.
+ * The first frame of a node after a gateway frame reached it is taken as the acknowledgement of that command.
+ *
+ * The script has one step per line, "<time in ms> <target> <action> [argument]", with # starting a comment:
+ *  gateway uart <text>		broadcast a frame over the bridge, escapes as in the wlad_host script
+ *  gateway end				end of the run
+ *  <nodes> <action> [arg]	a wlad_host script step straight at the nodes: uart, hex, pir or supply
+ * where <nodes> is all, a node number or a first-last range, nodes counted from 0.
+ *
+ * Usage: wlad_fleet [-n nodes] [-l latency ms] [-j jitter ms] [-b air kbit/s] [-o overhead bytes] [-p loss %]
+ *                   [-t seconds] [-s seed] [script]
+ * The VLO of every node is drawn within 10 % of 12 kHz, so the checkpoints of the nodes drift apart as on real hardware.
+ * The run ends at -t, at an end step, or else ten seconds after the last step. A report of every gateway command, the
+ * command latency, the collisions and the airtime is printed at the end.
+ */
+
+#ifdef HOST_FLEET
+
+#define HAL_HOST_SIMULATION
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include "msp430_host.h"
+
+#define FLEET_MS						(HOST_SMCLK_HZ / 1000)
+#define FLEET_STACK_SIZE				65536
+#define FLEET_MAX_FRAME					64											// Bytes of a frame on the air
+#define FLEET_VLO_HZ					12000
+#define FLEET_VLO_SPREAD				1200
+#define FLEET_TARGETS					-1											// Node of a gateway step
+
+/* Events of the loop */
+enum fleet_event_type
+{
+	FLEET_WAKE,																		// A node asked to be run again
+	FLEET_STEP,																		// A script step is due
+	FLEET_AIR_START,																// A transmission starts
+	FLEET_AIR_END,
+	FLEET_DELIVER																	// A gateway frame reaches a node
+};
+
+struct fleet_event
+{
+	unsigned long long time;
+	unsigned long order;															// Events at the same time in the order they were made
+	unsigned char type;
+	int node;
+	unsigned long index;															// Step, transmission or wake up generation
+};
+
+/* A packet on the air */
+struct fleet_transmission
+{
+	int node;																		// FLEET_TARGETS for the gateway
+	unsigned long command;															// Command of a gateway frame
+	unsigned long long sent;														// Frame handed to the bridge or BLE module
+	unsigned long long start;
+	unsigned long long end;
+	unsigned char collided;
+	unsigned char length;
+	unsigned char data[FLEET_MAX_FRAME];
+};
+
+/* A gateway frame and its acknowledgements */
+struct fleet_command
+{
+	unsigned long long time;
+	char text[40];
+	unsigned long reached;															// Nodes the frame reached
+	unsigned long acknowledged;
+	unsigned long long *latency;													// Of each acknowledgement, sorted for the report
+};
+
+struct fleet_step
+{
+	unsigned long long time;
+	int first;																		// FLEET_TARGETS for the gateway
+	int last;
+	char action[8];
+	char argument[120];
+};
+
+struct fleet_node
+{
+	ucontext_t context;
+	unsigned char *image;															// State of main.c and hal_host.c while not running
+	unsigned long long next;														// Wake up asked for
+	unsigned long generation;														// Of the wake up still wanted
+	unsigned char input;															// Woken for new input
+	unsigned char frame[FLEET_MAX_FRAME];											// Characters sent since the last \r
+	unsigned char frame_length;
+	long command;																	// Gateway frame waiting for an acknowledgement, -1 if none
+};
+
+/* State of the firmware and of its peripherals, see Makefile */
+extern unsigned char __start_wlad_data[], __stop_wlad_data[], __start_wlad_bss[], __stop_wlad_bss[];
+
+static unsigned long node_count = 2000;
+static unsigned long long latency = 20 * FLEET_MS;
+static unsigned long long jitter = 30 * FLEET_MS;
+static unsigned long air_kbps = 1000;
+static unsigned long overhead = 14;
+static double loss;
+static unsigned long long end_time = HOST_NEVER;
+static unsigned long long seed = 1;
+
+static struct fleet_node *nodes;
+static struct fleet_node *resident;												// Node whose image is in place
+static unsigned char *initial;													// Image of a node at reset
+static size_t data_size;
+static size_t bss_size;
+static ucontext_t loop_context;
+static unsigned long long now;
+
+static struct fleet_event *events;
+static unsigned long event_count;
+static unsigned long event_capacity;
+static unsigned long event_order;
+
+static struct fleet_step *steps;
+static unsigned long step_count;
+
+static struct fleet_transmission *transmissions;
+static unsigned long transmission_count;
+static unsigned long *on_air;													// Transmissions on the air now
+static unsigned long on_air_count;
+
+static struct fleet_command *commands;
+static unsigned long command_count;
+
+/* Totals of the report */
+static unsigned long long air_busy;
+static unsigned long long air_busy_until;
+static unsigned long long air_time[2];											// Uplink, downlink
+static unsigned long packets[2];
+static unsigned long collided[2];
+static unsigned long lost[2];
+static unsigned long long *uplink_latency;
+static unsigned long uplink_delivered;
+static unsigned long events_received;											// Node frames that were not acknowledgements
+
+static void *fleet_alloc(void *pointer, size_t size)
+{
+	pointer = realloc(pointer, size);
+	if(pointer == NULL)
+	{
+		fprintf(stderr, "wlad_fleet: out of memory\n");
+		exit(1);
+	}
+	return pointer;
+}
+
+/* xorshift64*, the same run for the same seed */
+static double fleet_random(void)
+{
+	seed ^= seed >> 12;
+	seed ^= seed << 25;
+	seed ^= seed >> 27;
+	return (double) ((seed * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+static double fleet_ms(unsigned long long time)
+{
+	return (double) time / (double) FLEET_MS;
+}
+
+/* Event queue, a binary heap on time and order */
+static int fleet_before(const struct fleet_event *first, const struct fleet_event *second)
+{
+	return (first->time < second->time) || ((first->time == second->time) && (first->order < second->order));
+}
+
+static void fleet_post(unsigned long long time, unsigned char type, int node, unsigned long index)
+{
+	unsigned long position = event_count++;
+	struct fleet_event event;
+
+	if(event_count > event_capacity)
+	{
+		event_capacity = event_capacity ? (event_capacity * 2) : 1024;
+		events = fleet_alloc(events, event_capacity * sizeof(*events));
+	}
+	event.time 	= time;
+	event.order = event_order++;
+	event.type 	= type;
+	event.node 	= node;
+	event.index = index;
+	while((position > 0) && fleet_before(&event, &events[(position - 1) / 2]))
+	{
+		events[position] = events[(position - 1) / 2];
+		position = (position - 1) / 2;
+	}
+	events[position] = event;
+}
+
+static struct fleet_event fleet_take(void)
+{
+	struct fleet_event first = events[0];
+	struct fleet_event last = events[--event_count];
+	unsigned long position = 0;
+	unsigned long child;
+
+	while((child = (2 * position) + 1) < event_count)
+	{
+		if((child + 1 < event_count) && fleet_before(&events[child + 1], &events[child]))
+		{
+			child++;
+		}
+		if(!fleet_before(&events[child], &last))
+		{
+			break;
+		}
+		events[position] = events[child];
+		position = child;
+	}
+	events[position] = last;
+	return first;
+}
+
+/* Puts the state of node in place of that of the node resident until now */
+static void fleet_swap_in(struct fleet_node *node)
+{
+	if(resident == node)
+	{
+		return;
+	}
+	if(resident != NULL)
+	{
+		memcpy(resident->image, __start_wlad_data, data_size);
+		memcpy(resident->image + data_size, __start_wlad_bss, bss_size);
+	}
+	memcpy(__start_wlad_data, node->image, data_size);
+	memcpy(__start_wlad_bss, node->image + data_size, bss_size);
+	resident = node;
+}
+
+/* Runs a node until it sleeps again, input set if it was woken for new input rather than at the time it asked for */
+static void fleet_run(int index, unsigned char input)
+{
+	struct fleet_node *node = &nodes[index];
+
+	fleet_swap_in(node);
+	node->input = input;
+	swapcontext(&loop_context, &node->context);
+	node->generation++;
+	if(node->next != HOST_NEVER)
+	{
+		fleet_post(node->next, FLEET_WAKE, index, node->generation);
+	}
+}
+
+/* Called by hal_host.c in the coroutine of the running node before its clock moves on to next */
+int fleet_yield(unsigned long long next)
+{
+	struct fleet_node *node = resident;
+
+	node->next = next;
+	swapcontext(&node->context, &loop_context);
+	return node->input;
+}
+
+static void fleet_node_main(void)
+{
+	char address[8];
+	unsigned long index = resident - nodes;
+
+	sprintf(address, "%04lX", index & 0xFFFF);
+	host_node_start(address, FLEET_VLO_HZ - FLEET_VLO_SPREAD + (unsigned long) (fleet_random() * 2 * FLEET_VLO_SPREAD));
+}
+
+static unsigned long long fleet_air_time(unsigned int length)
+{
+	return ((unsigned long long) (overhead + length) * 8 * HOST_SMCLK_HZ) / (air_kbps * 1000);
+}
+
+/* Queues a packet handed over at sent for the air, to start at time */
+static void fleet_transmit(int node, unsigned long command, const unsigned char *data, unsigned int length,
+							unsigned long long sent, unsigned long long time)
+{
+	struct fleet_transmission *packet;
+
+	transmissions = fleet_alloc(transmissions, (transmission_count + 1) * sizeof(*transmissions));
+	packet = &transmissions[transmission_count];
+	packet->node 		= node;
+	packet->command 	= command;
+	packet->sent 		= sent;
+	packet->start 		= time;
+	packet->end 		= time + fleet_air_time(length);
+	packet->collided 	= 0;
+	packet->length 		= (length < FLEET_MAX_FRAME) ? length : FLEET_MAX_FRAME;
+	memcpy(packet->data, data, packet->length);
+	fleet_post(time, FLEET_AIR_START, node, transmission_count++);
+}
+
+/* Called by hal_host.c for every character the running node sends, its BLE module sends each frame up to \r */
+void fleet_uart_send(unsigned char character, unsigned long long time)
+{
+	struct fleet_node *node = resident;
+
+	if(node->frame_length < FLEET_MAX_FRAME)
+	{
+		node->frame[node->frame_length++] = character;
+	}
+	if(character != '\r')
+	{
+		return;
+	}
+	if((node->frame_length != 2) || (node->frame[0] != 'p'))						// Not the address request to the module
+	{
+		fleet_transmit(node - nodes, 0, node->frame, node->frame_length, time,
+						time + (unsigned long long) (fleet_random() * jitter));
+	}
+	node->frame_length = 0;
+}
+
+static void fleet_air_start(unsigned long index)
+{
+	struct fleet_transmission *packet = &transmissions[index];
+	unsigned long other;
+	unsigned char direction = (packet->node == FLEET_TARGETS) ? 1 : 0;
+
+	for(other = 0; other < on_air_count; other++)
+	{
+		transmissions[on_air[other]].collided = 1;
+		packet->collided = 1;
+	}
+	on_air = fleet_alloc(on_air, (on_air_count + 1) * sizeof(*on_air));
+	on_air[on_air_count++] = index;
+
+	packets[direction]++;
+	air_time[direction] += packet->end - packet->start;
+	if(packet->end > air_busy_until)
+	{
+		air_busy += packet->end - ((packet->start > air_busy_until) ? packet->start : air_busy_until);
+		air_busy_until = packet->end;
+	}
+	fleet_post(packet->end, FLEET_AIR_END, packet->node, index);
+}
+
+static void fleet_air_end(unsigned long index)
+{
+	struct fleet_transmission *packet = &transmissions[index];
+	struct fleet_command *command;
+	struct fleet_node *node;
+	unsigned long other;
+	unsigned long target;
+	unsigned char direction = (packet->node == FLEET_TARGETS) ? 1 : 0;
+
+	for(other = 0; on_air[other] != index; other++)
+	{
+	}
+	on_air[other] = on_air[--on_air_count];
+
+	if(packet->collided)
+	{
+		collided[direction]++;
+		return;
+	}
+	if(direction == 1)																// Broadcast through the mesh
+	{
+		for(target = 0; target < node_count; target++)
+		{
+			if(fleet_random() < loss)
+			{
+				lost[direction]++;
+				continue;
+			}
+			fleet_post(packet->end + (unsigned long long) (fleet_random() * jitter), FLEET_DELIVER, target, index);
+		}
+		return;
+	}
+	if(fleet_random() < loss)
+	{
+		lost[direction]++;
+		return;
+	}
+
+	node = &nodes[packet->node];
+	uplink_latency = fleet_alloc(uplink_latency, (uplink_delivered + 1) * sizeof(*uplink_latency));
+	uplink_latency[uplink_delivered++] = packet->end + latency - packet->sent;
+	if(node->command < 0)
+	{
+		events_received++;
+		return;
+	}
+	command = &commands[node->command];
+	command->latency[command->acknowledged++] = packet->end + latency - command->time;
+	node->command = -1;
+}
+
+static void fleet_deliver(int target, unsigned long index)
+{
+	struct fleet_transmission *packet = &transmissions[index];
+
+	commands[packet->command].reached++;
+	nodes[target].command = packet->command;
+	fleet_swap_in(&nodes[target]);
+	host_node_receive(now, packet->data, packet->length);
+	fleet_run(target, 1);
+}
+
+static void fleet_step(const struct fleet_step *step)
+{
+	struct fleet_command *command;
+	unsigned char data[sizeof(step->argument)];
+	unsigned int length;
+	int target;
+
+	if(step->first != FLEET_TARGETS)
+	{
+		for(target = step->first; target <= step->last; target++)
+		{
+			fleet_swap_in(&nodes[target]);
+			host_node_step(now, step->action, step->argument);
+			fleet_run(target, 1);
+		}
+		return;
+	}
+	if(strcmp(step->action, "end") == 0)
+	{
+		end_time = now;
+		return;
+	}
+	if(strcmp(step->action, "uart") != 0)
+	{
+		fprintf(stderr, "wlad_fleet: the gateway only sends uart frames or ends the run\n");
+		exit(1);
+	}
+
+	commands = fleet_alloc(commands, (command_count + 1) * sizeof(*commands));
+	command = &commands[command_count];
+	command->time 			= now;
+	strncpy(command->text, step->argument, sizeof(command->text) - 1);
+	command->text[sizeof(command->text) - 1] = '\0';
+	command->reached 		= 0;
+	command->acknowledged 	= 0;
+	command->latency 		= fleet_alloc(NULL, node_count * sizeof(*command->latency));
+	length = host_unescape(step->argument, data);
+	fleet_transmit(FLEET_TARGETS, command_count++, data, length, now, now + latency);
+}
+
+/* Reads the script, times in ms from reset, into steps */
+static void fleet_read_script(FILE *file)
+{
+	char line[200];
+	char target[24];
+	char action[16];
+	double time;
+	int used;
+	char *argument;
+	size_t length;
+	struct fleet_step *step;
+
+	while(fgets(line, sizeof(line), file) != NULL)
+	{
+		if((line[0] == '#') || (sscanf(line, "%lf %23s %15s %n", &time, target, action, &used) < 3))
+		{
+			continue;
+		}
+		argument = line + used;
+		length = strlen(argument);
+		while((length > 0) && ((argument[length - 1] == '\n') || (argument[length - 1] == '\r') || (argument[length - 1] == ' ')))
+		{
+			argument[--length] = '\0';
+		}
+		steps = fleet_alloc(steps, (step_count + 1) * sizeof(*steps));
+		step = &steps[step_count];
+		step->time = (unsigned long long) (time * FLEET_MS);
+		if(strcmp(target, "gateway") == 0)
+		{
+			step->first = step->last = FLEET_TARGETS;
+		}
+		else if(strcmp(target, "all") == 0)
+		{
+			step->first = 0;
+			step->last 	= node_count - 1;
+		}
+		else if(sscanf(target, "%d-%d", &step->first, &step->last) != 2)
+		{
+			step->last = step->first = atoi(target);
+		}
+		if((step->first != FLEET_TARGETS)
+				&& ((step->first < 0) || (step->last < step->first) || (step->last >= (int) node_count)))
+		{
+			fprintf(stderr, "wlad_fleet: no node %s at %.3f ms\n", target, time);
+			exit(1);
+		}
+		strncpy(step->action, action, sizeof(step->action) - 1);
+		step->action[sizeof(step->action) - 1] = '\0';
+		strncpy(step->argument, argument, sizeof(step->argument) - 1);
+		step->argument[sizeof(step->argument) - 1] = '\0';
+		fleet_post(step->time, FLEET_STEP, step->first, step_count++);
+	}
+}
+
+static int fleet_compare(const void *first, const void *second)
+{
+	unsigned long long a = *(const unsigned long long *) first;
+	unsigned long long b = *(const unsigned long long *) second;
+
+	return (a > b) - (a < b);
+}
+
+/* Prints the 50th and 99th percentile and the longest of count latencies */
+static void fleet_percentiles(unsigned long long *latency_list, unsigned long count)
+{
+	if(count == 0)
+	{
+		printf("\n");
+		return;
+	}
+	qsort(latency_list, count, sizeof(*latency_list), fleet_compare);
+	printf(", latency p50 %.1f ms, p99 %.1f ms, max %.1f ms\n", fleet_ms(latency_list[(count - 1) / 2]),
+			fleet_ms(latency_list[((count * 99) + 99) / 100 - 1]), fleet_ms(latency_list[count - 1]));
+}
+
+static double fleet_share(unsigned long part, unsigned long whole)
+{
+	return (whole != 0) ? (100.0 * part / whole) : 0.0;
+}
+
+static void fleet_report(void)
+{
+	unsigned long index;
+	unsigned long reached = 0;
+	unsigned long acknowledged = 0;
+	unsigned long long *all_latency = fleet_alloc(NULL, (node_count * command_count + 1) * sizeof(*all_latency));
+
+	printf("%lu nodes, %.3f s, bridge latency %.1f ms, jitter %.1f ms, %lu kbit/s, %lu bytes overhead, loss %.1f %%\n",
+			node_count, fleet_ms(now) / 1000, fleet_ms(latency), fleet_ms(jitter), air_kbps, overhead, 100 * loss);
+	for(index = 0; index < command_count; index++)
+	{
+		printf("command %10.3f ms  %-16s reached %lu, acknowledged %lu (%.1f %%)", fleet_ms(commands[index].time),
+				commands[index].text, commands[index].reached, commands[index].acknowledged,
+				fleet_share(commands[index].acknowledged, node_count));
+		memcpy(all_latency + acknowledged, commands[index].latency, commands[index].acknowledged * sizeof(*all_latency));
+		reached 		+= commands[index].reached;
+		acknowledged 	+= commands[index].acknowledged;
+		fleet_percentiles(commands[index].latency, commands[index].acknowledged);
+	}
+	printf("commands  %lu sent, %lu reached, %lu acknowledged (%.1f %% of nodes and commands)", command_count, reached,
+			acknowledged, fleet_share(acknowledged, node_count * command_count));
+	fleet_percentiles(all_latency, acknowledged);
+	printf("uplink    %lu packets, %lu collided (%.1f %%), %lu lost, %lu events besides acknowledgements",
+			packets[0], collided[0], fleet_share(collided[0], packets[0]), lost[0], events_received);
+	fleet_percentiles(uplink_latency, uplink_delivered);
+	printf("downlink  %lu packets, %lu collided (%.1f %%), %lu deliveries lost\n",
+			packets[1], collided[1], fleet_share(collided[1], packets[1]), lost[1]);
+	printf("air       %.3f s busy (%.1f %% of the run), uplink %.3f s, downlink %.3f s\n", fleet_ms(air_busy) / 1000,
+			(now != 0) ? (100.0 * air_busy / now) : 0.0, fleet_ms(air_time[0]) / 1000, fleet_ms(air_time[1]) / 1000);
+	free(all_latency);
+}
+
+int main(int argc, char **argv)
+{
+	FILE *script = stdin;
+	struct fleet_event event;
+	unsigned long index;
+	int argument;
+
+	for(argument = 1; argument < argc; argument++)
+	{
+		if((argv[argument][0] == '-') && (argv[argument][1] != '\0') && (argv[argument][2] == '\0') && (argument + 1 < argc))
+		{
+			switch(argv[argument++][1])
+			{
+			case 'n':	node_count 	= strtoul(argv[argument], NULL, 10);									continue;
+			case 'l':	latency 	= (unsigned long long) (atof(argv[argument]) * FLEET_MS);				continue;
+			case 'j':	jitter 		= (unsigned long long) (atof(argv[argument]) * FLEET_MS);				continue;
+			case 'b':	air_kbps 	= strtoul(argv[argument], NULL, 10);									continue;
+			case 'o':	overhead 	= strtoul(argv[argument], NULL, 10);									continue;
+			case 'p':	loss 		= atof(argv[argument]) / 100;											continue;
+			case 't':	end_time 	= (unsigned long long) (atof(argv[argument]) * HOST_SMCLK_HZ);		continue;
+			case 's':	seed 		= strtoull(argv[argument], NULL, 10) | 1;								continue;
+			default:	argument--;																	break;
+			}
+		}
+		if((script = fopen(argv[argument], "r")) == NULL)
+		{
+			fprintf(stderr, "usage: wlad_fleet [-n nodes] [-l latency ms] [-j jitter ms] [-b air kbit/s] "
+					"[-o overhead bytes] [-p loss %%] [-t seconds] [-s seed] [script]\n");
+			return 1;
+		}
+	}
+	if((node_count == 0) || (air_kbps == 0) || (loss < 0) || (loss > 1))
+	{
+		fprintf(stderr, "wlad_fleet: nodes and bit rate must not be 0, loss is between 0 and 100 %%\n");
+		return 1;
+	}
+	fleet_read_script(script);
+	if((end_time == HOST_NEVER) && (step_count > 0))
+	{
+		end_time = steps[step_count - 1].time + (10 * HOST_SMCLK_HZ);				// Ten seconds after the last step
+	}
+	if(end_time == HOST_NEVER)
+	{
+		end_time = 60 * HOST_SMCLK_HZ;
+	}
+
+	/* Every node starts from the image at reset, the firmware starts running when the node is first run */
+	data_size 	= __stop_wlad_data - __start_wlad_data;
+	bss_size 	= __stop_wlad_bss - __start_wlad_bss;
+	initial 	= fleet_alloc(NULL, data_size + bss_size);
+	memcpy(initial, __start_wlad_data, data_size);
+	memcpy(initial + data_size, __start_wlad_bss, bss_size);
+	nodes = fleet_alloc(NULL, node_count * sizeof(*nodes));
+	for(index = 0; index < node_count; index++)
+	{
+		nodes[index].image 			= fleet_alloc(NULL, data_size + bss_size);
+		nodes[index].frame_length 	= 0;
+		nodes[index].command 		= -1;
+		nodes[index].generation 	= 0;
+		memcpy(nodes[index].image, initial, data_size + bss_size);
+		getcontext(&nodes[index].context);
+		nodes[index].context.uc_stack.ss_sp 	= fleet_alloc(NULL, FLEET_STACK_SIZE);
+		nodes[index].context.uc_stack.ss_size 	= FLEET_STACK_SIZE;
+		nodes[index].context.uc_link 			= NULL;
+		makecontext(&nodes[index].context, fleet_node_main, 0);
+		fleet_run(index, 0);
+	}
+
+	while(event_count > 0)
+	{
+		event = fleet_take();
+		if(event.time > end_time)
+		{
+			break;
+		}
+		now = event.time;
+		switch(event.type)
+		{
+		case FLEET_WAKE:
+			if(event.index == nodes[event.node].generation)							// Not planned again meanwhile
+			{
+				fleet_run(event.node, 0);
+			}
+			break;
+
+		case FLEET_STEP:
+			fleet_step(&steps[event.index]);
+			break;
+
+		case FLEET_AIR_START:
+			fleet_air_start(event.index);
+			break;
+
+		case FLEET_AIR_END:
+			fleet_air_end(event.index);
+			break;
+
+		case FLEET_DELIVER:
+			fleet_deliver(event.node, event.index);
+			break;
+		}
+	}
+	now = (end_time != HOST_NEVER) ? end_time : now;
+	fleet_report();
+	return 0;
+}
+
+#endif /* HOST_FLEET */
@@ -0,0 +1,810 @@
+/* Host build of the wireless LAD firmware: simulated MSP430G2553 peripherals
+ *
+ * The firmware of main.c runs unchanged on top of a simulated clock counted in SMCLK cycles. The firmware itself takes
+ * no simulated time. The clock moves on only while the firmware sleeps in a low power mode or waits in a HAL_WAIT()
+ * loop, and a flash erase or write stalls it for as long as the flash timing generator would. The simulation then
+ * jumps straight to the next thing that happens:
+ *  - the watchdog interval checkpoints, from an ACLK running at the VLO frequency;
+ *  - the PWM period interrupt of Timer0;
+ *  - the compare interrupts and the ACLK capture of Timer1, whose counter runs at SMCLK;
+ *  - characters received from the script at the UART bit rate, and the transmit interrupt once a character is sent;
+ *  - PIR edges on P1.5 from the script, and the ADC10 conversions of VCC at the supply voltage set by the script.
+ * A simulated BLE module answers the address request "p\r" of the firmware.
+ *
+ * The script has one step per line, "<time in ms> <action> [argument]", with # starting a comment:
+ *  uart <text>		send text to the firmware, \r, \n, \\ and \xNN escapes are taken
+ *  hex <nn nn ..>	send bytes given in hex
+ *  pir <1|0>		set the PIR output
+ *  supply <low|ok|mV>	supply voltage, low is 2500 mV and ok 3300 mV
+ *  end				end of the run
+ *
+ * Usage: wlad_host [-f flash image] [-v VLO Hz] [-b BLE address|none] [-t seconds] [script]
+ * The flash image keeps the info memory and the table log between runs. Without a script the steps are read from stdin.
+ * The run ends at -t, at an end step, or else ten seconds after the last step.
+ * Characters sent by the firmware, relay changes and the settled PWM duty are printed with the simulated time.
+ *
+ * Built with HOST_FLEET defined, the same simulation runs one node of fleet.c. The script and main() are left out, the
+ * clock of the node moves on only when fleet_yield() lets it, and the characters sent go to the BLE bridge of fleet.c.
+ */
+
+#ifdef HOST_BUILD
+
+#define HAL_HOST_SIMULATION
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "msp430_host.h"
+
+#define HOST_UART_CHARACTER				(HOST_SMCLK_HZ * 10 / 115200)				// SMCLK cycles per character at 115200 8N1
+#define HOST_ACLK_CHECKPOINT			8192ULL										// ACLK cycles per watchdog interval, WDT_ADLY_250
+#define HOST_FLASH_DIVIDER				24											// FN bits of FCTL2 set by FLASH_INIT(), plus one
+#define HOST_FLASH_ERASE				(4819ULL * HOST_FLASH_DIVIDER)				// Segment erase in SMCLK cycles
+#define HOST_FLASH_WRITE				(30ULL * HOST_FLASH_DIVIDER)				// Byte write in SMCLK cycles
+#define HOST_INFO_START					0x1000
+#define HOST_INFO_SIZE					0x0100
+#define HOST_INFO_SEGMENT				64
+#define HOST_MAIN_START					0xC000
+#define HOST_MAIN_SEGMENT				512
+#ifdef HOST_FLEET
+#define HOST_MAIN_SIZE					0x0400										// The table log only, swapped with every node
+#define HOST_MAX_RX						256
+#else
+#define HOST_MAIN_SIZE					0x4000
+#define HOST_MAX_RX						4096										// Characters waiting to be received
+#endif
+#define HOST_MAX_TX						64											// Characters printed on one line
+
+/* Peripheral registers */
+volatile unsigned int WDTCTL;
+volatile unsigned char IE1, IFG1, IE2, IFG2;
+volatile unsigned char DCOCTL, BCSCTL1, BCSCTL2, BCSCTL3;
+const unsigned char CALBC1_8MHZ = 0x8D, CALDCO_8MHZ = 0x92;
+volatile unsigned char UCA0CTL0, UCA0CTL1, UCA0BR0, UCA0BR1, UCA0MCTL, UCA0STAT, UCA0RXBUF, UCA0TXBUF;
+volatile unsigned char P1IN, P1OUT, P1DIR, P1IFG, P1IES, P1IE, P1SEL, P1SEL2, P1REN;
+volatile unsigned char P2IN, P2OUT, P2DIR, P2IFG, P2IES, P2IE, P2SEL, P2SEL2, P2REN;
+volatile unsigned int TA0CTL, TA0R, TA0CCTL0, TA0CCTL1, TA0CCTL2, TA0CCR0, TA0CCR1, TA0CCR2, TA0IV;
+volatile unsigned int TA1CTL, TA1R, TA1CCTL0, TA1CCTL1, TA1CCTL2, TA1CCR0, TA1CCR1, TA1CCR2, TA1IV;
+volatile unsigned int FCTL1, FCTL2, FCTL3 = FWKEY + LOCK;
+volatile unsigned int ADC10CTL0, ADC10CTL1, ADC10MEM;
+volatile unsigned char ADC10AE0;
+
+/* Script steps not yet taken, in time order */
+struct host_step
+{
+	unsigned long long time;
+	char action[8];
+	char argument[120];
+};
+
+static struct host_step *steps;
+static unsigned int step_count;
+static unsigned int step_next;
+
+/* Simulated clock and CPU */
+static unsigned long long now;													// SMCLK cycles since reset
+static unsigned long long end_time = HOST_NEVER;
+static unsigned long vlo_hz = 12000;
+static unsigned char gie;
+static unsigned char wake;
+
+/* Timers */
+static unsigned long long timer1_base;											// Time TA1R was 0
+static unsigned long long next_aclk;											// Next ACLK rising edge
+static unsigned long long next_checkpoint = HOST_NEVER;
+static unsigned long long next_pwm = HOST_NEVER;
+
+/* UART and BLE module */
+static unsigned char rx_data[HOST_MAX_RX];
+static unsigned long long rx_time[HOST_MAX_RX];
+static unsigned int rx_first;
+static unsigned int rx_last;
+static unsigned long long tx_ready;												// Transmitter free again
+static unsigned char tx_line[HOST_MAX_TX];
+static unsigned int tx_length;
+static unsigned long long tx_start;
+static char ble_address[8] = "0A0B";
+static unsigned char ble_request;												// Characters of "p\r" seen
+
+/* Supply */
+static unsigned long supply_mv = 3300;
+
+/* Flash */
+static unsigned char info_flash[HOST_INFO_SIZE];
+static unsigned char main_flash[HOST_MAIN_SIZE];
+static const char *flash_file;
+static unsigned long flash_erases;
+static unsigned long flash_writes;
+
+/* Outputs already reported */
+static unsigned char relay_reported = 0xFF;
+static unsigned int duty_reported = 0xFFFF;
+static unsigned long relay_starts;
+
+static double host_ms(unsigned long long time)
+{
+	return (double) time * 1000.0 / (double) HOST_SMCLK_HZ;
+}
+
+/* Prints the characters sent by the firmware that are still on the line */
+static void host_flush_tx(void)
+{
+	unsigned int index;
+
+	if(tx_length == 0)
+	{
+		return;
+	}
+	printf("%12.3f ms  tx ", host_ms(tx_start));
+	for(index = 0; index < tx_length; index++)
+	{
+		printf(" %02x", tx_line[index]);
+	}
+	printf("  |");
+	for(index = 0; index < tx_length; index++)
+	{
+		putchar(((tx_line[index] >= ' ') && (tx_line[index] < 0x7F)) ? tx_line[index] : '.');
+	}
+	printf("|\n");
+	tx_length = 0;
+}
+
+#ifndef HOST_FLEET
+/* Reports the relay as soon as it changes, and the PWM duty once no fade or blink moves it any more */
+static void host_report_outputs(void)
+{
+	unsigned char relay = (P2OUT & BIT2) ? 1 : 0;
+
+	if(relay != relay_reported)
+	{
+		host_flush_tx();
+		printf("%12.3f ms  relay %s\n", host_ms(now), relay ? "on" : "off");
+		if(relay && (relay_reported == 0))
+		{
+			relay_starts++;
+		}
+		relay_reported = relay;
+	}
+	if(((TA0CCTL0 & CCIE) == 0) && (TA0CCR1 != duty_reported))
+	{
+		host_flush_tx();
+		printf("%12.3f ms  pwm duty %u/%u\n", host_ms(now), TA0CCR1, TA0CCR0);
+		duty_reported = TA0CCR1;
+	}
+}
+#endif
+
+static void host_save_flash(void)
+{
+	FILE *file;
+
+	if((flash_file == NULL) || ((file = fopen(flash_file, "wb")) == NULL))
+	{
+		return;
+	}
+	fwrite(info_flash, 1, sizeof(info_flash), file);
+	fwrite(main_flash, 1, sizeof(main_flash), file);
+	fclose(file);
+}
+
+/* Ends the run once nothing is left to happen before end_time */
+static void host_finish(const char *reason)
+{
+	host_flush_tx();
+	printf("%12.3f ms  end, %s: %lu flash segment erases, %lu flash byte writes, %lu relay starts\n",
+			host_ms(now), reason, flash_erases, flash_writes, relay_starts);
+	host_save_flash();
+	exit(0);
+}
+
+/* Queues characters to be received by the firmware at the UART bit rate, from time on */
+static void host_receive(const unsigned char *data, unsigned int length, unsigned long long time)
+{
+	unsigned long long previous = (rx_first != rx_last) ? rx_time[(rx_last - 1) % HOST_MAX_RX] : 0;
+
+	while(length--)
+	{
+		if((rx_last - rx_first) >= HOST_MAX_RX)
+		{
+			fprintf(stderr, "wlad_host: too many characters waiting to be received\n");
+			exit(1);
+		}
+		if(time < previous + HOST_UART_CHARACTER)
+		{
+			time = previous + HOST_UART_CHARACTER;
+		}
+		rx_data[rx_last % HOST_MAX_RX] = *data++;
+		rx_time[rx_last % HOST_MAX_RX] = time;
+		rx_last++;
+		previous = time;
+	}
+}
+
+/* Turns the text of a uart step into the bytes sent, \r, \n, \\ and \xNN escapes taken, data as long as text */
+unsigned int host_unescape(const char *text, unsigned char *data)
+{
+	unsigned int length = 0;
+	char *next;
+
+	while(*text != '\0')
+	{
+		if((text[0] == '\\') && (text[1] == 'x'))
+		{
+			data[length++] = (unsigned char) strtoul(text + 2, &next, 16);
+			text = next;
+			continue;
+		}
+		if(text[0] == '\\')
+		{
+			text++;
+			data[length++] = (*text == 'r') ? '\r' : (*text == 'n') ? '\n' : *text;
+			text += (*text != '\0') ? 1 : 0;
+			continue;
+		}
+		data[length++] = *text++;
+	}
+	return length;
+}
+
+/* Takes a script step that is due */
+static void host_take_step(const struct host_step *step)
+{
+	unsigned char data[sizeof(step->argument)];
+	unsigned int length = 0;
+	const char *text = step->argument;
+	char *next;
+	unsigned char before;
+
+	if(strcmp(step->action, "uart") == 0)
+	{
+		length = host_unescape(text, data);
+		host_receive(data, length, now);
+	}
+	else if(strcmp(step->action, "hex") == 0)
+	{
+		while(length < sizeof(data))
+		{
+			data[length] = (unsigned char) strtoul(text, &next, 16);
+			if(next == text)
+			{
+				break;
+			}
+			text = next;
+			length++;
+		}
+		host_receive(data, length, now);
+	}
+	else if(strcmp(step->action, "pir") == 0)
+	{
+		before = P1IN;
+		P1IN = (atoi(text) != 0) ? (P1IN | BIT5) : (P1IN & ~BIT5);
+		if((before ^ P1IN) & BIT5)
+		{
+			if(((P1IN & BIT5) != 0) == ((P1IES & BIT5) == 0))						// Edge selected by P1IES
+			{
+				P1IFG |= BIT5;
+			}
+		}
+	}
+	else if(strcmp(step->action, "supply") == 0)
+	{
+		if(strcmp(text, "low") == 0)
+		{
+			supply_mv = 2500;
+		}
+		else if(strcmp(text, "ok") == 0)
+		{
+			supply_mv = 3300;
+		}
+		else
+		{
+			supply_mv = strtoul(text, NULL, 10);
+		}
+	}
+	else if(strcmp(step->action, "end") == 0)
+	{
+		end_time = now;
+	}
+}
+
+/* ADC10 result of the channel selected, only VCC/2 is connected */
+static unsigned int host_adc10(void)
+{
+	unsigned long reference = (ADC10CTL0 & REF2_5V) ? 2500 : 1500;
+	unsigned long counts;
+
+	if((ADC10CTL1 & 0xF000) != INCH_11)
+	{
+		return 0;
+	}
+	counts = (supply_mv * 1023) / (2 * reference);
+	return (counts > 1023) ? 1023 : counts;
+}
+
+/* Brings the registers the firmware reads up to the present time */
+static void host_sync(void)
+{
+	if(TA1CTL & TACLR)
+	{
+		timer1_base = now;
+		TA1CTL &= ~TACLR;
+	}
+	TA1R = (TA1CTL & MC_3) ? ((now - timer1_base) & 0xFFFF) : TA1R;
+	if(now >= tx_ready)
+	{
+		UCA0STAT &= ~UCBUSY;
+		IFG2 |= UCA0TXIFG;
+	}
+	if((ADC10CTL0 & (ADC10ON + ENC + ADC10SC)) == (ADC10ON + ENC + ADC10SC))	// A conversion takes no time
+	{
+		ADC10MEM = host_adc10();
+		ADC10CTL0 = (ADC10CTL0 & ~ADC10SC) | ADC10IFG;
+	}
+}
+
+/* Cycles until Timer1 counts up to compare, a whole period when it is there already */
+static unsigned long long host_timer1_compare(unsigned int compare)
+{
+	unsigned long long ticks = (compare - TA1R) & 0xFFFF;
+
+	return now + ((ticks == 0) ? 0x10000 : ticks);
+}
+
+static void host_interrupt(void (*isr)(void))
+{
+	gie = 0;																		// Cleared on entry as on the MSP430
+	isr();
+	gie = 1;
+	host_sync();
+#ifndef HOST_FLEET
+	host_report_outputs();
+#endif
+}
+
+/*********************************************************************************************************************************
+ * Function name			: host_advance()
+ * Passing parameters 		: None
+ * Returning parameters 	: 0 if nothing is left to happen before end_time
+ * Description 				: Moves the clock to the next thing that happens and lets it happen: a script step, a flag set by the
+ * 							  hardware, or an interrupt when GIE is set. Sources due at the same time are taken in the order of
+ * 							  their interrupt priority.
+ *********************************************************************************************************************************/
+static int host_advance(void)
+{
+	unsigned long long next = HOST_NEVER;
+	unsigned long long pwm_period = ((unsigned long long) TA0CCR0 + 1) * 8;
+	unsigned long long checkpoint = HOST_ACLK_CHECKPOINT * HOST_SMCLK_HZ / vlo_hz;
+	unsigned long long watchdog = HOST_NEVER;
+	unsigned long long timer1_ccr0 = HOST_NEVER;
+	unsigned long long timer1_ccr2 = HOST_NEVER;
+	unsigned long long aclk = HOST_SMCLK_HZ / vlo_hz;
+	unsigned long long rx = HOST_NEVER;
+	unsigned long long tx = HOST_NEVER;
+	unsigned long long script = (step_next < step_count) ? steps[step_next].time : HOST_NEVER;
+
+	host_sync();
+
+	/* Interrupts whose flag is already set */
+	if(gie)
+	{
+		if((ADC10CTL0 & ADC10IE) && (ADC10CTL0 & ADC10IFG))
+		{
+			ADC10CTL0 &= ~ADC10IFG;
+			host_interrupt(Supply_sag);
+			return 1;
+		}
+		if((P1IE & BIT5) && (P1IFG & BIT5))
+		{
+			host_interrupt(Port_1);
+			return 1;
+		}
+	}
+
+	/* When each source is due next, the interrupts only with GIE set */
+	if((IE1 & WDTIE) && (WDTCTL & WDTTMSEL) && ((WDTCTL & WDTHOLD) == 0))
+	{
+		if(next_checkpoint == HOST_NEVER)
+		{
+			next_checkpoint = now + checkpoint;
+		}
+		if(gie)
+		{
+			watchdog = (next_checkpoint > now) ? next_checkpoint : now;			// A checkpoint held back by GIE is taken at once
+		}
+	}
+	else
+	{
+		next_checkpoint = HOST_NEVER;
+	}
+	if((TA0CTL & MC_3) && (TA0CCTL0 & CCIE) && gie)
+	{
+		if((next_pwm == HOST_NEVER) || (next_pwm < now))
+		{
+			next_pwm = now + pwm_period;
+		}
+	}
+	else
+	{
+		next_pwm = HOST_NEVER;
+	}
+	if(TA1CTL & MC_3)
+	{
+		if((TA1CCTL0 & CCIE) && ((TA1CCTL0 & CAP) == 0) && gie)
+		{
+			timer1_ccr0 = host_timer1_compare(TA1CCR0);
+		}
+		if((TA1CCTL2 & CCIE) && gie)
+		{
+			timer1_ccr2 = host_timer1_compare(TA1CCR2);
+		}
+	}
+	if(TA1CCTL0 & CAP)
+	{
+		if(next_aclk <= now)
+		{
+			next_aclk = ((now / aclk) + 1) * aclk;
+		}
+	}
+	else
+	{
+		next_aclk = HOST_NEVER;
+	}
+	if((rx_first != rx_last) && (IE2 & UCA0RXIE) && gie)
+	{
+		rx = (rx_time[rx_first % HOST_MAX_RX] > now) ? rx_time[rx_first % HOST_MAX_RX] : now;
+	}
+	if((IE2 & UCA0TXIE) && gie)
+	{
+		tx = (tx_ready > now) ? tx_ready : now;
+	}
+
+	next = script;
+	next = (watchdog < next) ? watchdog : next;
+	next = (next_pwm < next) ? next_pwm : next;
+	next = (timer1_ccr0 < next) ? timer1_ccr0 : next;
+	next = (timer1_ccr2 < next) ? timer1_ccr2 : next;
+	next = (next_aclk < next) ? next_aclk : next;
+	next = (rx < next) ? rx : next;
+	next = (tx < next) ? tx : next;
+#ifdef HOST_FLEET
+	if(fleet_yield(next) != 0)														// Woken early with new input, plan again
+	{
+		return 1;
+	}
+#endif
+	if((next == HOST_NEVER) || (next > end_time))
+	{
+		return 0;
+	}
+	now = next;
+	host_sync();
+
+	if(next == script)
+	{
+		host_take_step(&steps[step_next++]);
+	}
+	else if(next == watchdog)
+	{
+		next_checkpoint += checkpoint;
+		host_interrupt(Checkpoint_timer);
+	}
+	else if(next == next_pwm)
+	{
+		next_pwm += pwm_period;
+		host_interrupt(Timer_A);
+	}
+	else if(next == rx)
+	{
+		UCA0RXBUF = rx_data[rx_first++ % HOST_MAX_RX];
+		host_interrupt(USCI0RX_ISR);
+	}
+	else if(next == tx)
+	{
+		host_interrupt(USCI0TX_ISR);
+	}
+	else if(next == timer1_ccr0)
+	{
+		host_interrupt(Timer_A2);
+	}
+	else if(next == timer1_ccr2)
+	{
+		TA1IV = 4;
+		host_interrupt(Timer_A1);
+		TA1IV = 0;
+	}
+	else if(next == next_aclk)
+	{
+		TA1CCR0 = TA1R;																// Capture on the ACLK edge
+		TA1CCTL0 |= CCIFG;
+		next_aclk += aclk;
+	}
+	return 1;
+}
+
+/* Intrinsics */
+void __bis_SR_register(unsigned int bits)
+{
+	if(bits & GIE)
+	{
+		gie = 1;
+	}
+	if(bits & CPUOFF)
+	{
+		wake = 0;
+		while(wake == 0)
+		{
+			if(host_advance() == 0)
+			{
+				host_finish((end_time == HOST_NEVER) ? "script done" : "end time");
+			}
+		}
+	}
+}
+
+void __bic_SR_register_on_exit(unsigned int bits)
+{
+	if(bits & CPUOFF)
+	{
+		wake = 1;
+	}
+}
+
+void __disable_interrupt(void)
+{
+	gie = 0;
+}
+
+void __enable_interrupt(void)
+{
+	gie = 1;
+}
+
+/* HAL */
+void hal_host_uart_send(unsigned char character)
+{
+#ifdef HOST_FLEET
+	fleet_uart_send(character, now);
+#else
+	if((tx_length == HOST_MAX_TX) || ((tx_length != 0) && (now > tx_ready + HOST_UART_CHARACTER)))
+	{
+		host_flush_tx();
+	}
+	if(tx_length == 0)
+	{
+		tx_start = now;
+	}
+	tx_line[tx_length++] = character;
+#endif
+	UCA0TXBUF = character;
+	UCA0STAT |= UCBUSY;
+	IFG2 &= ~UCA0TXIFG;
+	tx_ready = now + HOST_UART_CHARACTER;
+
+	/* BLE module: the address request "p\r" is answered with the address */
+	ble_request = ((character == 'p') || ((ble_request == 1) && (character == '\r'))) ? (ble_request + 1) : 0;
+	if((ble_request == 2) && (ble_address[0] != '\0'))
+	{
+		host_receive((const unsigned char *) ble_address, strlen(ble_address), now + (HOST_SMCLK_HZ / 1000));
+		ble_request = 0;
+	}
+}
+
+unsigned char hal_host_uart_receive(void)
+{
+	return UCA0RXBUF;
+}
+
+unsigned char *hal_host_flash(unsigned int address)
+{
+	if(address == 0)
+	{
+		return NULL;
+	}
+	if((address >= HOST_INFO_START) && (address < HOST_INFO_START + HOST_INFO_SIZE))
+	{
+		return &info_flash[address - HOST_INFO_START];
+	}
+	if((address >= HOST_MAIN_START) && (address - HOST_MAIN_START < HOST_MAIN_SIZE))
+	{
+		return &main_flash[address - HOST_MAIN_START];
+	}
+	fprintf(stderr, "wlad_host: flash access to 0x%04x outside the flash\n", address);
+	exit(1);
+}
+
+/* Segment of the flash holding pointer, with its size */
+static unsigned char *host_segment(unsigned char *pointer, unsigned int *size)
+{
+	if((pointer >= info_flash) && (pointer < info_flash + HOST_INFO_SIZE))
+	{
+		*size = HOST_INFO_SEGMENT;
+		return info_flash + ((pointer - info_flash) / HOST_INFO_SEGMENT) * HOST_INFO_SEGMENT;
+	}
+	*size = HOST_MAIN_SEGMENT;
+	return main_flash + ((pointer - main_flash) / HOST_MAIN_SEGMENT) * HOST_MAIN_SEGMENT;
+}
+
+/* Checks that the flash controller was set up for an operation, as a wrong key or a lock gives an access violation */
+static void host_flash_check(unsigned int mode, const char *operation)
+{
+	if(((FCTL1 & 0xFF00) != FWKEY) || ((FCTL1 & mode) == 0) || (FCTL3 & LOCK) || ((FCTL2 & 0xFF00) != FWKEY))
+	{
+		fprintf(stderr, "wlad_host: flash %s at %.3f ms without the flash controller set up for it\n", operation, host_ms(now));
+		exit(1);
+	}
+}
+
+void hal_host_flash_erase(unsigned char *pointer)
+{
+	unsigned int size;
+	unsigned char *segment = host_segment(pointer, &size);
+
+	host_flash_check(ERASE, "erase");
+	memset(segment, 0xFF, size);
+	flash_erases++;
+	now += HOST_FLASH_ERASE;														// The CPU is held while the flash is busy
+}
+
+void hal_host_flash_write(unsigned char *pointer, unsigned char value)
+{
+	host_flash_check(WRT, "write");
+	*pointer &= value;																// Programming only clears bits
+	flash_writes++;
+	now += HOST_FLASH_WRITE;
+}
+
+void hal_host_wait(void)
+{
+	if(host_advance() == 0)
+	{
+		host_finish("stalled waiting for the hardware");
+	}
+}
+
+#ifdef HOST_FLEET
+
+/* A node of fleet.c starts from reset with a blank flash, running the firmware until the end of the fleet run */
+void host_node_start(const char *address, unsigned long vlo)
+{
+	memset(info_flash, 0xFF, sizeof(info_flash));
+	memset(main_flash, 0xFF, sizeof(main_flash));
+	strncpy(ble_address, address, sizeof(ble_address) - 1);
+	vlo_hz = vlo;
+	firmware_main();
+}
+
+/* Characters received by the node from its BLE module, the first at time */
+void host_node_receive(unsigned long long time, const unsigned char *data, unsigned int length)
+{
+	now = (time > now) ? time : now;
+	host_receive(data, length, now);
+}
+
+/* A step of the wlad_host script taken by the node at time */
+void host_node_step(unsigned long long time, const char *action, const char *argument)
+{
+	struct host_step step;
+
+	now = (time > now) ? time : now;
+	step.time = now;
+	strncpy(step.action, action, sizeof(step.action) - 1);
+	step.action[sizeof(step.action) - 1] = '\0';
+	strncpy(step.argument, argument, sizeof(step.argument) - 1);
+	step.argument[sizeof(step.argument) - 1] = '\0';
+	host_take_step(&step);
+}
+
+#else
+
+/* Reads the script, times in ms from reset, into steps */
+static void host_read_script(FILE *file)
+{
+	char line[160];
+	char action[16];
+	double time;
+	int used;
+	unsigned int capacity = 0;
+	char *argument;
+	size_t length;
+
+	while(fgets(line, sizeof(line), file) != NULL)
+	{
+		if((line[0] == '#') || (sscanf(line, "%lf %15s %n", &time, action, &used) < 2))
+		{
+			continue;
+		}
+		argument = line + used;
+		length = strlen(argument);
+		while((length > 0) && ((argument[length - 1] == '\n') || (argument[length - 1] == '\r') || (argument[length - 1] == ' ')))
+		{
+			argument[--length] = '\0';
+		}
+		if(step_count == capacity)
+		{
+			capacity = capacity ? (capacity * 2) : 64;
+			steps = realloc(steps, capacity * sizeof(*steps));
+			if(steps == NULL)
+			{
+				exit(1);
+			}
+		}
+		steps[step_count].time = (unsigned long long) (time * (HOST_SMCLK_HZ / 1000));
+		strncpy(steps[step_count].action, action, sizeof(steps[step_count].action) - 1);
+		steps[step_count].action[sizeof(steps[step_count].action) - 1] = '\0';
+		strncpy(steps[step_count].argument, argument, sizeof(steps[step_count].argument) - 1);
+		steps[step_count].argument[sizeof(steps[step_count].argument) - 1] = '\0';
+		if((step_count > 0) && (steps[step_count].time < steps[step_count - 1].time))
+		{
+			fprintf(stderr, "wlad_host: script steps are not in time order at %.3f ms\n", time);
+			exit(1);
+		}
+		step_count++;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	FILE *script = stdin;
+	FILE *file;
+	int index;
+
+	memset(info_flash, 0xFF, sizeof(info_flash));
+	memset(main_flash, 0xFF, sizeof(main_flash));
+	for(index = 1; index < argc; index++)
+	{
+		if((strcmp(argv[index], "-f") == 0) && (index + 1 < argc))
+		{
+			flash_file = argv[++index];
+			if((file = fopen(flash_file, "rb")) != NULL)
+			{
+				if((fread(info_flash, 1, sizeof(info_flash), file) != sizeof(info_flash))
+						|| (fread(main_flash, 1, sizeof(main_flash), file) != sizeof(main_flash)))
+				{
+					fprintf(stderr, "wlad_host: %s is not a flash image\n", flash_file);
+					return 1;
+				}
+				fclose(file);
+			}
+		}
+		else if((strcmp(argv[index], "-v") == 0) && (index + 1 < argc))
+		{
+			vlo_hz = strtoul(argv[++index], NULL, 10);
+		}
+		else if((strcmp(argv[index], "-b") == 0) && (index + 1 < argc))
+		{
+			index++;
+			strncpy(ble_address, (strcmp(argv[index], "none") == 0) ? "" : argv[index], sizeof(ble_address) - 1);
+		}
+		else if((strcmp(argv[index], "-t") == 0) && (index + 1 < argc))
+		{
+			end_time = (unsigned long long) (atof(argv[++index]) * HOST_SMCLK_HZ);
+		}
+		else if((script = fopen(argv[index], "r")) == NULL)
+		{
+			fprintf(stderr, "usage: wlad_host [-f flash image] [-v VLO Hz] [-b BLE address|none] [-t seconds] [script]\n");
+			return 1;
+		}
+	}
+	if((vlo_hz < 4000) || (vlo_hz > 20000))
+	{
+		fprintf(stderr, "wlad_host: the VLO runs between 4 and 20 kHz\n");
+		return 1;
+	}
+	host_read_script(script);
+
+	if((end_time == HOST_NEVER) && (step_count > 0))
+	{
+		end_time = steps[step_count - 1].time + (10 * HOST_SMCLK_HZ);				// Ten seconds after the last step
+	}
+	if(end_time == HOST_NEVER)
+	{
+		end_time = 60 * HOST_SMCLK_HZ;
+	}
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	firmware_main();
+	return 0;
+}
+
+#endif /* HOST_FLEET */
+
+#endif /* HOST_BUILD */
@@ -0,0 +1,163 @@
+/* Host build of the wireless LAD firmware: MSP430G2553 registers, intrinsics and HAL macros on simulated peripherals
+ *
+ * The registers main.c uses are plain variables, read and written by the simulation in hal_host.c between the steps of
+ * the firmware. Register and bit names and values follow msp430g2553.h. Interrupts are delivered only while the firmware
+ * sleeps or waits in a HAL_WAIT() loop with GIE set, so a run is reproducible for the same input script.
+ */
+
+#ifndef MSP430_HOST_H_
+#define MSP430_HOST_H_
+
+/* Simulated time, in SMCLK cycles */
+#define HOST_SMCLK_HZ					8000000ULL
+#define HOST_NEVER						(~0ULL)
+
+/* Peripheral registers */
+extern volatile unsigned int WDTCTL;
+extern volatile unsigned char IE1, IFG1, IE2, IFG2;
+extern volatile unsigned char DCOCTL, BCSCTL1, BCSCTL2, BCSCTL3;
+extern const unsigned char CALBC1_8MHZ, CALDCO_8MHZ;
+extern volatile unsigned char UCA0CTL0, UCA0CTL1, UCA0BR0, UCA0BR1, UCA0MCTL, UCA0STAT, UCA0RXBUF, UCA0TXBUF;
+extern volatile unsigned char P1IN, P1OUT, P1DIR, P1IFG, P1IES, P1IE, P1SEL, P1SEL2, P1REN;
+extern volatile unsigned char P2IN, P2OUT, P2DIR, P2IFG, P2IES, P2IE, P2SEL, P2SEL2, P2REN;
+extern volatile unsigned int TA0CTL, TA0R, TA0CCTL0, TA0CCTL1, TA0CCTL2, TA0CCR0, TA0CCR1, TA0CCR2, TA0IV;
+extern volatile unsigned int TA1CTL, TA1R, TA1CCTL0, TA1CCTL1, TA1CCTL2, TA1CCR0, TA1CCR1, TA1CCR2, TA1IV;
+extern volatile unsigned int FCTL1, FCTL2, FCTL3;
+extern volatile unsigned int ADC10CTL0, ADC10CTL1, ADC10MEM;
+extern volatile unsigned char ADC10AE0;
+
+#define CCR0							TA0CCR0
+#define CCR1							TA0CCR1
+#define CCR2							TA0CCR2
+
+#define BIT0							0x0001
+#define BIT1							0x0002
+#define BIT2							0x0004
+#define BIT3							0x0008
+#define BIT4							0x0010
+#define BIT5							0x0020
+#define BIT6							0x0040
+#define BIT7							0x0080
+
+/* Status register */
+#define GIE								0x0008
+#define CPUOFF							0x0010
+#define OSCOFF							0x0020
+#define SCG0							0x0040
+#define SCG1							0x0080
+#define LPM0_bits						(CPUOFF)
+#define LPM3_bits						(SCG1 + SCG0 + CPUOFF)
+
+/* Watchdog */
+#define WDTPW							0x5A00
+#define WDTHOLD							0x0080
+#define WDTTMSEL						0x0010
+#define WDTCNTCL						0x0008
+#define WDTSSEL							0x0004
+#define WDT_ADLY_250					(WDTPW + WDTTMSEL + WDTCNTCL + WDTSSEL)
+#define WDTIE							0x01
+
+/* Basic clock */
+#define LFXT1S_2						0x20
+
+/* USCI_A0 */
+#define UCA0RXIE						0x01
+#define UCA0TXIE						0x02
+#define UCA0RXIFG						0x01
+#define UCA0TXIFG						0x02
+#define UCSSEL_2						0x80
+#define UCSWRST							0x01
+#define UCBRS0							0x02
+#define UCBUSY							0x01
+
+/* Timer_A */
+#define TASSEL_2						0x0200
+#define ID_3							0x00C0
+#define MC_1							0x0010
+#define MC_2							0x0020
+#define MC_3							0x0030
+#define TACLR							0x0004
+#define CM_1							0x4000
+#define CCIS_1							0x1000
+#define CAP								0x0100
+#define OUTMOD_0						0x0000
+#define OUTMOD_3						0x0060
+#define CCIE							0x0010
+#define OUT								0x0004
+#define CCIFG							0x0001
+
+/* Flash */
+#define FWKEY							0xA500
+#define FSSEL_2							0x0080
+#define FN0								0x0001
+#define FN1								0x0002
+#define FN2								0x0004
+#define FN4								0x0010
+#define ERASE							0x0002
+#define WRT								0x0040
+#define LOCK							0x0010
+
+/* ADC10 */
+#define SREF_1							0x2000
+#define ADC10SHT_2						0x1000
+#define ADC10SHT_3						0x1800
+#define REF2_5V							0x0040
+#define REFON							0x0020
+#define ADC10ON							0x0010
+#define ADC10IE							0x0008
+#define ADC10IFG						0x0004
+#define ENC								0x0002
+#define ADC10SC							0x0001
+#define INCH_5							0x5000
+#define INCH_11							0xB000
+#define ADC10DIV_7						0x00E0
+
+/* Intrinsics and interrupt service routines */
+#define __interrupt
+void __bis_SR_register(unsigned int bits);
+void __bic_SR_register_on_exit(unsigned int bits);
+void __disable_interrupt(void);
+void __enable_interrupt(void);
+
+/* HAL, see hal.h */
+#define HAL_UART_SEND(character)			hal_host_uart_send(character)
+#define HAL_UART_RECEIVE()					hal_host_uart_receive()
+#define HAL_FLASH(address)					hal_host_flash(address)
+#define HAL_FLASH_ERASE(pointer)			hal_host_flash_erase(pointer)
+#define HAL_FLASH_WRITE(pointer, value)		hal_host_flash_write(pointer, value)
+#define HAL_WAIT()							hal_host_wait()
+
+void hal_host_uart_send(unsigned char character);
+unsigned char hal_host_uart_receive(void);
+unsigned char *hal_host_flash(unsigned int address);
+void hal_host_flash_erase(unsigned char *pointer);
+void hal_host_flash_write(unsigned char *pointer, unsigned char value);
+void hal_host_wait(void);
+
+/* Fleet simulation, see fleet.c. Every node runs the firmware in a coroutine of its own, with its state swapped in. */
+#ifdef HOST_FLEET
+unsigned int host_unescape(const char *text, unsigned char *data);
+void host_node_start(const char *address, unsigned long vlo);
+void host_node_receive(unsigned long long time, const unsigned char *data, unsigned int length);
+void host_node_step(unsigned long long time, const char *action, const char *argument);
+int fleet_yield(unsigned long long next);
+void fleet_uart_send(unsigned char character, unsigned long long time);
+#endif
+
+/* The firmware main() is started by the simulation */
+#ifndef HAL_HOST_SIMULATION
+#define main							firmware_main
+#endif
+void firmware_main(void);
+
+/* Interrupt service routines of main.c, called by the simulation */
+void USCI0RX_ISR(void);
+void USCI0TX_ISR(void);
+void Timer_A(void);
+void Checkpoint_timer(void);
+void Supply_sag(void);
+void Timer_A2(void);
+void Timer_A1(void);
+void Port_1(void);
+
+#endif /* MSP430_HOST_H_ */
@@ -1,14 +1,38 @@
 /* Wireless LAD version 2.8
  *
  * This version covers the following features:
- * 1. Linear Output
+ * 1. Linear Output, the piecewise linear duty mapping of the earlier versions is kept as the default dimming curve
  * 2. Send 254 and 255 for \n and \r respectively
  * 3. Grouping feature has been added
  * 4. Scene selection feature has been added
  * 5. UART interrupt modification
+ * 6. Table driven command dispatcher using a compile time perfect hash of the opcodes
+ * 7. Interrupt driven UART transmit queue
+ * 8. UART receive queue with frame detection and inter-character gap timeout
+ * 9. Negotiable binary protocol: COBS framed opcode, address, length, payload and CRC-16
+ * 10. Batched binary commands with a single acknowledgement
+ * 11. Non-blocking fade engine running in the PWM period interrupt
+ * 12. Dimming curve lookup table generated at compile time, square law and CIE 1976 L* curves selectable
+ * 13. Fades of a fixed duration set in milliseconds
+ * 14. Identify blinking runs in the background
+ * 15. PIR debouncing sampled from a timer with a configurable window and confirmation count
+ * 16. Main loop runs only the handlers of the events posted by the interrupts
+ * 17. Occupancy time out counted from the VLO in coarse watchdog interval checkpoints
+ * 18. LPM3 while idle, time outs kept from the VLO calibrated against the DCO
+ * 19. Wear levelled configuration log with a check per record across info segments B, C and D
+ * 20. Settings written to flash by themselves after an idle period and when ADC10 measures the supply sag
+ * 21. Commands accepted straight after reset, PIR warm-up and BLE address request run in the background
+ * 22. Settings kept in one versioned struct config, loaded in a single pass and migrated between versions
+ * 23. Occupancy history of the last 24 hours in a RAM ring, read in BLE MTU sized chunks with a cursor
+ * 24. Energy meter integrated each minute from the PWM duty and relay state, kept in the configuration log
+ * 25. Table of 16 scenes with level, fade time and relay state, stored as one record in main flash with the settings
+ * 26. Membership of any of the 254 groups kept as a bitmap in main flash with the settings, frames matched with a bit test
+ * 27. UART data, flash and polling loops go through hal.h and the other peripherals by register, simulated for Linux in host/
+ * 28. Cycle count benchmarks of the hot paths and interrupts in the simulator of mspdebug, see bench/
+ * 29. Fleet simulation of thousands of nodes behind a modeled BLE bridge, running the host build, see host/fleet.c
  */
 
-#include <msp430g2553.h>
+#include "hal.h"
 
 /* Seat occupancy definitions */
 #define MAX_DUTY 						3333
@@ -21,10 +45,13 @@
 #define true							1
 #define UNITY							1
 #define MAX_CHAR						8
-#define MAX_PIR_COUNT           		1
 #define LAST_CHAR						6
-#define NO_OF_COMMANDS					38
+#define NO_OF_COMMANDS					50
 #define SEND_MSG_LENGTH					2
+#define FRAME_HEADER_LENGTH				9											// "D " + 4 address characters + ' ' + 2 BLE address bytes
+#define FRAME_ROUTE_LENGTH				7											// "D " + 4 address characters + ' '
+#define FRAME_HOST						0
+#define FRAME_POLLING_HOST				1
 #define BROADCAST_ADDRESS				254
 #define SET_HOST_ADDRESS				0
 #define RESET_HOST_ADDRESS				1
@@ -64,24 +91,189 @@
 #define CLEAR_LIS_GROUP					35
 #define GET_HEALTH_STATUS				36
 #define RECEIVE_OWN_ADDRESS				37
+#define GET_TX_HIGH_WATER				38
+#define SET_BINARY_MODE					39
+#define SET_ASCII_MODE					40
+#define SET_FADE_TIME					41
+#define SET_IDENTIFY_COUNT				42
+#define SET_IDENTIFY_PERIOD				43
+#define SET_PIR_WINDOW					44
+#define SET_PIR_CONFIRM					45
+#define GET_EVENT_STATS					46
+#define SET_COMMIT_IDLE					47
+#define READ_OCCUPANCY					48
+#define READ_METER						49
+#define NO_COMMAND						255
+
+/* Command dispatcher definitions
+ * Each opcode (the characters after "AD") is hashed at compile time. COMMAND_SLOT() folds the hash into a
+ * COMMAND_TABLE_SIZE entry slot table which maps straight to the command index, so a received frame is
+ * resolved with at most one probe per opcode length instead of a scan of msg_arr. COMMAND_HASH_SEED is
+ * chosen so that no two opcodes share a slot; the build fails if a new command breaks this.
+ */
+#define COMMAND_TABLE_SIZE				128
+#define COMMAND_HASH_SEED				1171
+#define MIN_OPCODE_LENGTH				3
+#define COMMAND_HASH_STEP(hash, c)		((((hash) * 33u) ^ (c)) & 0xFFFFu)
+#define COMMAND_SLOT(hash)				(((hash) ^ ((hash) >> 7)) & (COMMAND_TABLE_SIZE - 1))
+#define COMMAND_HASH_1(a)				COMMAND_HASH_STEP(COMMAND_HASH_SEED, a)
+#define COMMAND_HASH_3(a, b, c)			COMMAND_HASH_STEP(COMMAND_HASH_STEP(COMMAND_HASH_1(a), b), c)
+#define COMMAND_HASH_4(a, b, c, d)		COMMAND_HASH_STEP(COMMAND_HASH_3(a, b, c), d)
+#define COMMAND_HASH_5(a, b, c, d, e)	COMMAND_HASH_STEP(COMMAND_HASH_4(a, b, c, d), e)
+
+/* X(arg, command index, opcode length, opcode hash, handler, allowed in a batch) - must be kept in command index order */
+#define COMMAND_LIST(X, arg) \
+	X(arg, SET_HOST_ADDRESS,		3,	COMMAND_HASH_1('H'),						command_set_host_address,				YES) \
+	X(arg, RESET_HOST_ADDRESS,		3,	COMMAND_HASH_1('R'),						command_reset_host_address,				YES) \
+	X(arg, POLLING_HOST_ADDRESS,	3,	COMMAND_HASH_1('P'),						command_polling_host_address,			YES) \
+	X(arg, SET_SENSING_FREQ,		5,	COMMAND_HASH_3('S','S','F'),				command_set_sensing_freq,				YES) \
+	X(arg, SET_TIMEOUT,				5,	COMMAND_HASH_3('S','T','O'),				command_set_timeout,					YES) \
+	X(arg, SET_POWER_ON_LEVEL,		5,	COMMAND_HASH_3('O','P','L'),				command_set_power_on_level,				YES) \
+	X(arg, SET_PERCENTAGE_LEVEL,	5,	COMMAND_HASH_3('S','P','L'),				command_set_percentage_level,			YES) \
+	X(arg, SET_FADE_RATE_VALUE,		5,	COMMAND_HASH_3('F','D','R'),				command_set_fade_rate_value,			YES) \
+	X(arg, SET_FADE_DELAY_VALUE,	5,	COMMAND_HASH_3('F','D','D'),				command_set_fade_delay_value,			YES) \
+	X(arg, SET_GROUP_NUMBER,		5,	COMMAND_HASH_3('S','G','P'),				command_set_group_number,				YES) \
+	X(arg, SET_SCENE_NUMBER,		5,	COMMAND_HASH_3('S','S','N'),				command_set_scene_number,				YES) \
+	X(arg, GET_SCENE_NUMBER,		5,	COMMAND_HASH_3('G','S','N'),				command_get_scene_number,				NO) \
+	X(arg, STORE_LIS_GROUP_NUMBER,	5,	COMMAND_HASH_3('S','T','G'),				command_store_lis_group_number,			YES) \
+	X(arg, GOTO_SCENE_NUMBER,		6,	COMMAND_HASH_4('G','T','S','N'),			command_goto_scene_number,				YES) \
+	X(arg, GET_GROUP_NUMBER,		6,	COMMAND_HASH_4('G','G','P','N'),			command_get_group_number,				NO) \
+	X(arg, CLEAR_SCENE,				6,	COMMAND_HASH_4('C','L','R','S'),			command_clear_scene,					YES) \
+	X(arg, IDENTIFY_DEVICE,			7,	COMMAND_HASH_5('I','D','D','E','V'),		command_identify_device,				NO) \
+	X(arg, FLASH_WRITE,				7,	COMMAND_HASH_5('W','R','F','L','S'),		command_flash_write,					YES) \
+	X(arg, SET_COMMISSIONING_FLAG,	7,	COMMAND_HASH_5('C','M','S','E','T'),		command_set_commissioning_flag,			YES) \
+	X(arg, RESET_COMMISSIONING_FLAG,7,	COMMAND_HASH_5('C','M','R','S','T'),		command_reset_commissioning_flag,		YES) \
+	X(arg, GET_SENSOR_DATA,			7,	COMMAND_HASH_5('G','S','D','0','0'),		command_get_sensor_data,				NO) \
+	X(arg, CLEAR_COUNT,				7,	COMMAND_HASH_5('C','L','R','O','S'),		command_clear_count,					YES) \
+	X(arg, RELAY_ON,				7,	COMMAND_HASH_5('L','A','D','O','N'),		command_relay_on,						YES) \
+	X(arg, RELAY_OFF,				7,	COMMAND_HASH_5('L','A','D','O','F'),		command_relay_off,						YES) \
+	X(arg, DISABLE_OS,				7,	COMMAND_HASH_5('D','I','S','O','S'),		command_disable_os,						YES) \
+	X(arg, ENABLE_OS,				7,	COMMAND_HASH_5('E','N','A','O','S'),		command_enable_os,						YES) \
+	X(arg, GET_SENSING_FREQ,		7,	COMMAND_HASH_5('G','S','F','0','0'),		command_get_sensing_freq,				NO) \
+	X(arg, FACTORY_RESET,			7,	COMMAND_HASH_5('F','T','R','S','T'),		command_factory_reset,					NO) \
+	X(arg, GET_SENSOR_SETTINGS,		7,	COMMAND_HASH_5('G','S','S','E','T'),		command_get_sensor_settings,			NO) \
+	X(arg, ENABLE_REQ_MODE,			7,	COMMAND_HASH_5('E','R','Q','O','S'),		command_enable_req_mode,				YES) \
+	X(arg, GET_TIMEOUT_VAL,			7,	COMMAND_HASH_5('G','T','O','O','S'),		command_get_timeout_val,				NO) \
+	X(arg, GET_PERCENTAGE_LEVEL,	7,	COMMAND_HASH_5('G','P','L','A','D'),		command_get_percentage_level,			NO) \
+	X(arg, GET_NO_OF_GROUPS,		7,	COMMAND_HASH_5('G','N','O','G','P'),		command_get_no_of_groups,				NO) \
+	X(arg, CLEAR_GROUP,				7,	COMMAND_HASH_5('C','L','R','G','P'),		command_clear_group,					YES) \
+	X(arg, GET_LIS_GROUP,			7,	COMMAND_HASH_5('G','G','P','L','S'),		command_get_lis_group,					NO) \
+	X(arg, CLEAR_LIS_GROUP,			7,	COMMAND_HASH_5('C','R','G','P','L'),		command_clear_lis_group,				YES) \
+	X(arg, GET_HEALTH_STATUS,		7,	COMMAND_HASH_5('G','S','T','A','T'),		command_get_health_status,				NO) \
+	X(arg, RECEIVE_OWN_ADDRESS,		7,	COMMAND_HASH_5('D','R','O','A','D'),		command_receive_own_address,			NO) \
+	X(arg, GET_TX_HIGH_WATER,		7,	COMMAND_HASH_5('G','T','X','H','W'),		command_get_tx_high_water,				NO) \
+	X(arg, SET_BINARY_MODE,			7,	COMMAND_HASH_5('B','I','N','M','D'),		command_set_binary_mode,				NO) \
+	X(arg, SET_ASCII_MODE,			7,	COMMAND_HASH_5('A','S','C','M','D'),		command_set_ascii_mode,					NO) \
+	X(arg, SET_FADE_TIME,			3,	COMMAND_HASH_1('T'),						command_set_fade_time,					YES) \
+	X(arg, SET_IDENTIFY_COUNT,		5,	COMMAND_HASH_3('I','D','C'),				command_set_identify_count,				YES) \
+	X(arg, SET_IDENTIFY_PERIOD,		5,	COMMAND_HASH_3('I','D','P'),				command_set_identify_period,			YES) \
+	X(arg, SET_PIR_WINDOW,			5,	COMMAND_HASH_3('D','B','W'),				command_set_pir_window,					YES) \
+	X(arg, SET_PIR_CONFIRM,			5,	COMMAND_HASH_3('D','B','C'),				command_set_pir_confirm,				YES) \
+	X(arg, GET_EVENT_STATS,			5,	COMMAND_HASH_3('E','V','S'),				command_get_event_stats,				NO) \
+	X(arg, SET_COMMIT_IDLE,			5,	COMMAND_HASH_3('C','M','T'),				command_set_commit_idle,				YES) \
+	X(arg, READ_OCCUPANCY,			5,	COMMAND_HASH_3('O','C','R'),				command_read_occupancy,					NO) \
+	X(arg, READ_METER,				5,	COMMAND_HASH_3('M','T','R'),				command_read_meter,						NO)
+
+#define COMMAND_PROTOTYPE(arg, id, length, hash, handler, batch)	void handler();
+#define COMMAND_POSITION(arg, id, length, hash, handler, batch)		COMMAND_POSITION_##id,
+#define COMMAND_SLOT_ENUM(arg, id, length, hash, handler, batch)	COMMAND_SLOT_##id = COMMAND_SLOT(hash),
+#define COMMAND_ORDER_CHECK(arg, id, length, hash, handler, batch)	STATIC_ASSERT(command_order_##id, COMMAND_POSITION_##id == id);
+#define COMMAND_SLOT_MASK(chunk, slot)								((((slot) >> 5) == (chunk)) ? (1UL << ((slot) & 31)) : 0UL)
+#define COMMAND_SLOT_SUM(chunk, id, length, hash, handler, batch)	+ COMMAND_SLOT_MASK(chunk, COMMAND_SLOT_##id)
+#define COMMAND_SLOT_OR(chunk, id, length, hash, handler, batch)	| COMMAND_SLOT_MASK(chunk, COMMAND_SLOT_##id)
+#define COMMAND_SLOT_OWNER(slot, id, length, hash, handler, batch)	(COMMAND_SLOT_##id == (slot)) ? id :
+#define COMMAND_LENGTH(arg, id, length, hash, handler, batch)		length,
+#define COMMAND_HANDLER(arg, id, length, hash, handler, batch)		handler,
+#define COMMAND_PARAMETERS(arg, id, length, hash, handler, batch)	COMMAND_PARAMETER_LENGTH(length),
+#define COMMAND_BATCH(arg, id, length, hash, handler, batch)		batch,
+#define COMMAND_SLOT_ROW(slot)										(COMMAND_LIST(COMMAND_SLOT_OWNER, slot) NO_COMMAND)
+#define COMMAND_SLOT_ROW_8(slot)									COMMAND_SLOT_ROW(slot),     COMMAND_SLOT_ROW(slot + 1), \
+																	COMMAND_SLOT_ROW(slot + 2), COMMAND_SLOT_ROW(slot + 3), \
+																	COMMAND_SLOT_ROW(slot + 4), COMMAND_SLOT_ROW(slot + 5), \
+																	COMMAND_SLOT_ROW(slot + 6), COMMAND_SLOT_ROW(slot + 7)
+/* Two opcodes share a slot exactly when the sum of the slot bits differs from their OR */
+#define COMMAND_SLOTS_UNIQUE(chunk)									((0UL COMMAND_LIST(COMMAND_SLOT_SUM, chunk)) == (0UL COMMAND_LIST(COMMAND_SLOT_OR, chunk)))
+#define STATIC_ASSERT(name, condition)								typedef char name[(condition) ? 1 : -1]
+
+/* Main loop events
+ * Interrupts post the bit of an event in pending_events and wake the CPU. The main loop takes all posted events at
+ * once, runs their handlers in list order and sleeps again as soon as nothing is pending. Handler runs and the longest
+ * run in MCLK cycles are kept per event and read with ADEVSxx. The run time is taken from Timer1, which is clocked
+ * from SMCLK = MCLK, so a run over 8 ms is recorded modulo 65536 cycles.
+ */
+/* X(event bit, handler) - the list position gives the bit */
+#define EVENT_LIST(X) \
+	X(EVENT_UART_FRAME,				handle_uart_frames) \
+	X(EVENT_MOTION,					handle_motion) \
+	X(EVENT_SENSING_TICK,			handle_sensing_tick) \
+	X(EVENT_OCCUPANCY_TIMEOUT,		handle_occupancy_timeout) \
+	X(EVENT_DIMMING,				handle_dimming) \
+	X(EVENT_CONFIG_COMMIT,			handle_config_commit) \
+	X(EVENT_BLE_ADDRESS,			handle_ble_address) \
+	X(EVENT_MINUTE,					handle_minute)
+
+#define EVENT_PROTOTYPE(event, handler)								void handler();
+#define EVENT_POSITION(event, handler)								event##_POSITION,
+#define EVENT_BIT(event, handler)									event = 1 << event##_POSITION,
+#define EVENT_HANDLER(event, handler)								handler,
+#define POST_EVENT(event)											pending_events |= (event)
 
-#define INPUT_VAL_COMMANDS				12
 #define LSB								6
 #define MSB								5
 #define ASCII_1							49
 #define ASCII_0							48											// ASCII value for '0'
 #define ASCII_UP_CASE					55
 #define ASCII_LOW_CASE					87
+#define IS_HEX(c)						((((c) >= '0') && ((c) <= '9')) || (((c) >= 'A') && ((c) <= 'F')) || (((c) >= 'a') && ((c) <= 'f')))
 #define TEN								10
 //#define _0P3_MILLI_SECOND				2500
 #define LOWER_BAUD						0x46
 #define HIGHER_BAUD						0x00
 #define UART_TIMEOUT					8000
 #define TIMER1CCR1						2
+#define TX_BUFFER_SIZE					32										// Must be a power of 2
+#define RX_BUFFER_SIZE					64										// Must be a power of 2
+#define RX_GAP_TIMEOUT					40000									// 5 ms inter-character gap at 8 MHz
+#define PIR_SAMPLE_TICKS				40000									// P1.5 sampled every 5 ms at 8 MHz during debounce
+#define BLE_ADDRESS_LENGTH				4
+#define BLE_ADDRESS_TIMEOUT				3											// Checkpoints waited for the BLE address, about 2 s
+#define BLE_ADDRESS_TRIES				5											// Requests sent before the BLE address is given up
+
+/* Binary protocol definitions
+ * The gateway switches a node to binary mode with ADBINMD and back with the SET_ASCII_MODE opcode; ASCII frames are
+ * still accepted in binary mode so that LIS commands from other nodes keep working. A binary request is opcode (the
+ * command index), address, parameter length, parameters and a big endian CRC-16/CCITT of the preceding bytes, COBS
+ * encoded and terminated by 0. A binary response is the "D <host address> " route followed by BLE address, opcode,
+ * length, payload and CRC-16, COBS encoded with '\r' as the delimiter so that the BLE module only sees its line
+ * terminator at the end of the frame. Code bytes are sent XORed with the delimiter, data bytes unchanged.
+ * A batch request (BINARY_BATCH_OPCODE) carries up to BATCH_MAX_OPS commands, each an opcode followed by its parameters.
+ * Only commands allowed in a batch are accepted, and their values are checked with command_refuses() before any of them
+ * runs. Either every command is run, with their own responses suppressed, or none is. The single response holds the
+ * number of commands run, a bitmap of the commands run and the position of the command that rejected the batch, or
+ * BATCH_ACCEPTED.
+ */
+#define ASCII_PROTOCOL					0
+#define BINARY_PROTOCOL					1
+#define BINARY_FRAME_FLAG				0x80										// Marks a binary frame in the receive queue length byte
+#define BINARY_FRAME_SIZE				40											// Largest binary request, encoded or decoded
+#define BINARY_RESPONSE_SIZE			18
+#define BINARY_BATCH_OPCODE				0x80
+#define BATCH_MAX_OPS					16											// One status bit each
+#define BATCH_RESPONSE_LENGTH			4
+#define BATCH_ACCEPTED					0xFF										// Rejecting position reported when the batch ran
+#define BINARY_REQUEST_OVERHEAD			5											// Opcode, address, length and CRC-16
+#define BINARY_RESPONSE_OVERHEAD		6											// BLE address, opcode, length and CRC-16
+#define CRC_LENGTH						2
+#define CRC16_INIT						0xFFFF
+#define COBS_REQUEST_DELIMITER			0
+#define COBS_RESPONSE_DELIMITER			13
+/* Binary parameters: 4 address characters for ADH/ADR/ADP, the value for the 5 and 6 character opcodes, none otherwise */
+#define COMMAND_PARAMETER_LENGTH(length)	(((length) == 3) ? 4 : (((length) < 7) ? 1 : 0))
 #define DEVICE_TYPE						8
 #define SET								1
 #define RESET							0
 
+/* Former fixed configuration layout in segment C, only read to migrate a node that has no configuration log yet */
 #define FLASH_ADDRESS_SENSING_FREQ		0x1040										// Segment C
 #define FLASH_ADDRESS_TIME_OUT			0x1042										// Segment C
 #define FLASH_HOST_ADDRESS				0x1044										// Segment C
@@ -112,34 +304,217 @@
 #define FLASH_POLLING_HOST_ADDRESS_2	0x107B
 #define FLASH_POLLING_HOST_ADDRESS_3	0x107C
 #define FLASH_POLLING_HOST_ADDRESS_4	0x107D
+#define FLASH_FADE_TIME					0x107E										// Segment C
+#define FLASH_FADE_TIME_1				0x107E
+#define FLASH_FADE_TIME_2				0x107F
 #define MAX_FLASH_VAL 					60
 
+/* Configuration log definitions
+ * The settings are the fields of struct config. ADWRFLS appends a record only for the items that changed since they
+ * were last written. A record is the item key, the number of values, the values and the CRC-16 of them all, so a
+ * record cut short by a power loss fails its check and ends the log, and a record of an item unknown to
+ * this firmware can be skipped. Info segments D, C and B are used in rotation. A segment counts once its header, the
+ * sequence number and its complement, has been written, which is done after anything else put into it. A generation of
+ * the log starts with a snapshot record of all items at the start of a segment and goes on into the next segment when
+ * it is full, the newest record of an item winning. The segment that would leave no free or outdated segment behind
+ * starts a new generation, so each generation spans two segments and is only erased once a newer one is complete. Nodes
+ * with nothing logged yet keep reading the former layout.
+ */
+#define CONFIG_FIRST_SEGMENT			0x1000										// Segment D, C and B follow
+#define CONFIG_SEGMENTS					3
+#define CONFIG_SEGMENT_SIZE				64
+#define CONFIG_HEADER_SIZE				4
+#define CONFIG_CHECK_SIZE				2											// CRC-16, most significant byte first
+#define CONFIG_RECORD_OVERHEAD			(2 + CONFIG_CHECK_SIZE)						// Key, number of values and check
+#define CONFIG_MAX_LENGTH				5
+#define CONFIG_FREE						0xFF
+#define CONFIG_SNAPSHOT					0x7F										// Key of the record holding a whole struct config
+#define CONFIG_VERSION					2											// struct config layout, fields are only ever added at its end
+#define CONFIG_VERSION_1_SIZE			CONFIG_FIELD_OFFSET(meter_energy)			// Version 1 ended before the energy meter
+
+/* X(key, field of struct config, address in the former layout or 0, address step between its values there)
+ * Keys are stored in the log, so new items only ever go at the end.
+ */
+#define CONFIG_LIST(X) \
+	X(CONFIG_SENSING_FREQ,			sensing_freq,			FLASH_ADDRESS_SENSING_FREQ,		1) \
+	X(CONFIG_TIME_OUT,				time_out,				FLASH_ADDRESS_TIME_OUT,			1) \
+	X(CONFIG_HOST_ADDRESS,			host_address,			FLASH_HOST_ADDRESS,				1) \
+	X(CONFIG_COM_FLAG,				commissioning_flag,		FLASH_ADDRESS_COM_FLAG,			1) \
+	X(CONFIG_FADE_RATE,				fade_rate,				FLASH_FADE_RATE_VALUE,			1) \
+	X(CONFIG_FADE_DELAY,			fade_delay,				FLASH_FADE_DELAY_VALUE,			1) \
+	X(CONFIG_PERCENTAGE,			power_on_value,			FLASH_PERCENTAGE_VALUE,			1) \
+	X(CONFIG_SCENES,				scenes,					FLASH_SCENE_ONE,				2) \
+	X(CONFIG_GROUPS,				groups,					FLASH_GROUP_ONE,				2) \
+	X(CONFIG_LIS_MODE,				lis_mode,				FLASH_LIS_MODE,					1) \
+	X(CONFIG_LIS_GROUP_NUMBER,		lis_group_number,		FLASH_LIS_GROUP_NUMBER,			1) \
+	X(CONFIG_POLLING_HOST_ADDRESS,	polling_host_address,	FLASH_POLLING_HOST_ADDRESS,		1) \
+	X(CONFIG_FADE_TIME,				fade_time,				FLASH_FADE_TIME,				1) \
+	X(CONFIG_COMMIT_IDLE,			commit_idle,			0,								1) \
+	X(CONFIG_METER_ENERGY,			meter_energy,			0,								1) \
+	X(CONFIG_METER_ON_TIME,			meter_on_time,			0,								1) \
+	X(CONFIG_METER_RELAY_CYCLES,	meter_relay_cycles,		0,								1)
+
+#define CONFIG_FIELD_SIZE(field)									sizeof(((struct config *) 0)->field)
+#define CONFIG_FIELD_OFFSET(field)									((unsigned int) ((char *) &((struct config *) 0)->field - (char *) 0))
+#define CONFIG_KEY(key, field, address, step)						key,
+#define CONFIG_OFFSET(key, field, address, step)					CONFIG_FIELD_OFFSET(field),
+#define CONFIG_LENGTH(key, field, address, step)					CONFIG_FIELD_SIZE(field),
+#define CONFIG_LEGACY_ADDRESS(key, field, address, step)			address,
+#define CONFIG_LEGACY_STEP(key, field, address, step)				step,
+#define CONFIG_LENGTH_CHECK(key, field, address, step)				STATIC_ASSERT(config_length_##key, CONFIG_FIELD_SIZE(field) <= CONFIG_MAX_LENGTH);
+
+/* Settings saved in the flash, as one snapshot record. Bytes only, so there is no padding on any compiler. */
+struct config
+{
+	unsigned char version;
+	unsigned char sensing_freq;
+	unsigned char time_out;
+	unsigned char host_address[4];
+	unsigned char commissioning_flag;
+	unsigned char fade_rate;
+	unsigned char fade_delay[2];
+	unsigned char power_on_value;
+	unsigned char scenes[5];
+	unsigned char groups[5];
+	unsigned char lis_mode;
+	unsigned char lis_group_number;
+	unsigned char polling_host_address[4];
+	unsigned char fade_time[2];
+	unsigned char commit_idle;
+	unsigned char meter_energy[4];											// Version 2 on, least significant byte first
+	unsigned char meter_on_time[4];
+	unsigned char meter_relay_cycles[4];
+};
+
+/* Supply monitor definitions
+ * Every checkpoint ADC10 measures VCC/2 (INCH_11) against the internal 2.5 V reference, so no pin or external divider
+ * is needed. A sample below SUPPLY_SAG_MV, well above the 2.2 V flash programming minimum, writes the energy meter and,
+ * with an automatic commit idle period set, the dirty settings. The next sag is only taken once a sample is back above
+ * SUPPLY_RECOVERED_MV. The reference settles within the 64 ADC10OSC / 8 cycle sample time.
+ */
+#define SUPPLY_SAG_MV					2800
+#define SUPPLY_RECOVERED_MV				3000
+#define SUPPLY_COUNTS(millivolts)		((unsigned int) (((millivolts) * 1023UL) / (2 * 2500UL)))	// ADC10MEM of VCC/2
+
+/* Minute statistics definitions
+ * Checkpoint_timer counts the checkpoints of the running minute with the occupancy time out running and with the relay
+ * on, the light output and the relay starts, and handle_minute() takes them once a minute.
+ */
+#define METER_LIGHT_SHIFT				5
+#define METER_LIGHT_FULL				(DUTY_OFF >> METER_LIGHT_SHIFT)				// Light output counted per checkpoint at full light
+#define METER_SAVE_INTERVAL				240											// Minutes between writes of the energy meter
+#define METER_SAVE_IDLE					10											// Seconds without a command before the meter is written, without commit_idle
+#define METER_ENERGY					0											// Light output in full light seconds
+#define METER_ON_TIME					1											// Seconds with the relay on
+#define METER_RELAY_CYCLES				2											// Relay starts
+#define METER_COUNTERS					3											// Four byte totals, all of them fit a binary response
+#define METER_TOTAL(counter)			((unsigned char *) &config + config_offset[CONFIG_METER_ENERGY + (counter)])
+
+/* Occupancy history definitions
+ * A minute counts as occupied when the occupancy time out ran for at least half of it. Every OCCUPANCY_INTERVAL the
+ * occupied minutes and the number of debounced PIR motions are packed into one sample byte: bit 7 set, bits 6-4 the
+ * occupied fraction of the interval in sevenths and bits 3-0 the motions, saturating at 13. Bit 7 keeps a sample clear
+ * of \n and \r and the saturation keeps it below the 254 and 255 they are escaped to, so the samples go out unescaped
+ * in ASCII frames as well. The last
+ * OCCUPANCY_SAMPLES samples are kept in a RAM ring and read oldest first with ADOCRxx, xx being the cursor: the
+ * response holds the samples kept and up to OCCUPANCY_CHUNK samples from the cursor on, so that one response fits a
+ * single BLE_MTU_PAYLOAD notification. The host reads on from cursor + the samples received until the cursor reaches
+ * the samples kept. The history starts empty after every reset.
+ */
+#define OCCUPANCY_INTERVAL				45											// Minutes per sample
+#define OCCUPANCY_SAMPLES				32											// 24 hours of samples
+#define OCCUPANCY_SAMPLE_FLAG			0x80
+#define OCCUPANCY_FRACTION_SHIFT		4
+#define OCCUPANCY_FRACTION_STEPS		7											// Occupied fraction of a whole interval
+#define OCCUPANCY_MOTIONS_MAX			13
+#define OCCUPANCY_CHUNK					4											// Samples per ADOCR response
+#define BLE_MTU_PAYLOAD					20											// Notification payload of the default 23 byte ATT MTU
+
 /* Occupancy sensor definitions */
 #define CALIB_CONST_ERASE    			0xFF										// default flash value after erasing
 #define INITIAL_DELAY 					30											// initial delay in mins for sensor stability
-#define _15_MIN 						270000										// timer count for 15 mins delay
-//#define _15_MIN 						18000										// timer count for 1 mins delay
-#define _30_MIN 						540000										// timer count for 30 mins delay
-#define _45_MIN 						810000										// timer count for 45 mins delay
-#define _60_MIN 						1080000										// timer count for 60 mins delay
+#define PIR_WARM_UP						5											// Seconds after reset before PIR motion is believed
+#define PIR_CONFIRM_SAMPLES				((pir_confirm < pir_window) ? pir_confirm : pir_window)
+#define _15_MIN 						(15 * _1_MIN)								// timer count for 15 mins delay
+#define _30_MIN 						(30 * _1_MIN)								// timer count for 30 mins delay
+#define _45_MIN 						(45 * _1_MIN)								// timer count for 45 mins delay
+#define _60_MIN 						(60 * _1_MIN)								// timer count for 60 mins delay
 #define _15_MIN_VAL						15
 #define _30_MIN_VAL						30
 #define _45_MIN_VAL						45
 #define _60_MIN_VAL						60
 #define PWM_WIDTH  						3333										// CCR0 period timer value
 #define TIMERCCR1						2
-#define _1_MIN							18000										// count for 1 min
+#define SMCLK_HZ						8000000UL
+#define VLO_NOMINAL_HZ					12000										// ACLK sourced from the VLO, replaced by the power on calibration
+#define VLO_CALIBRATION_CYCLES			32											// VLO cycles timed with SMCLK, at most 65535 SMCLK cycles
+#define ACLK_CHECKPOINT					8192UL										// ACLK cycles between watchdog interval interrupts
+#define CHECKPOINTS(seconds)			((((unsigned long)(seconds) * vlo_frequency) + (ACLK_CHECKPOINT / 2)) / ACLK_CHECKPOINT)
+#define _1_MIN							CHECKPOINTS(60)								// checkpoints in 1 min, about 0.7 s each
+#define FADE_DELAY_PER_PERIOD			2222										// Iterations of the former fade delay loop in one PWM period
+#define PWM_PERIOD_US					3333										// PWM_WIDTH counts at 1 MHz
+#define FADE_FRACTION_BITS				16											// Fixed point fade position, CCR1 in the upper word
+#define PWM_PERIODS_PER_100_MS			30
+
+/* Dimming curve definitions
+ * dimming_curve maps a level of 0 to 99 percent to the CCR1 value, DUTY_OFF being off and 0 full light. The table is
+ * computed by the compiler from the curve selected with DIMMING_CURVE, in integer arithmetic only: the piecewise linear
+ * mapping of the earlier versions (24 counts a level with the steps at 11 to 15 and 67), linear light output, square
+ * law, or CIE 1976 L* (perceived lightness) where the light output is ((L* + 16) / 116)^3 above L* = 8 and L* / 903.3
+ * below it. The piecewise mapping is the default so that installed fixtures keep their light levels, the others are
+ * opt in.
+ */
+#define DIMMING_CURVE_LINEAR			0
+#define DIMMING_CURVE_SQUARE			1
+#define DIMMING_CURVE_CIE				2
+#define DIMMING_CURVE_PIECEWISE			3
+#ifndef DIMMING_CURVE
+#define DIMMING_CURVE					DIMMING_CURVE_PIECEWISE
+#endif
+#define DIMMING_LEVELS					100
+#define MAX_LEVEL						(DIMMING_LEVELS - 1)
+#define DUTY_OFF						3300
+#define CURVE_LINEAR(p)					((DUTY_OFF * (unsigned long)(p) + 49) / 99)
+#define CURVE_SQUARE(p)					((DUTY_OFF * (unsigned long)(p) * (p) + 4900) / 9801)
+/* 12 * (L* + 16) for L* = p * 100 / 99 is 1584 * 1.012..., cubed and scaled so that level 99 gives DUTY_OFF */
+#define CURVE_CIE_BASE(p)				(((p) * 100UL + 1590) / 12)
+#define CURVE_CIE(p)					(((p) < 8) ? ((p) * 369UL / 100) : \
+										 (CURVE_CIE_BASE(p) * CURVE_CIE_BASE(p) * CURVE_CIE_BASE(p) / 265596UL))
+/* Light output of the former set_duty_cycle(), which gave CCR1 = 3300 - 24 * p up to level 10, 3085, 3084, 3080 and 3075
+ * for levels 11 to 14, 3070 - 24 * (p - 15) from level 15, 1780 - 24 * (p - 67) from level 67 and 0 at level 99 */
+#define CURVE_PIECEWISE(p)				(((p) <= 10) ? (p) * 24UL : ((p) == 11) ? 215UL : ((p) == 12) ? 216UL : \
+										 ((p) == 13) ? 220UL : ((p) == 14) ? 225UL : \
+										 ((p) <= 66) ? 230UL + ((p) - 15) * 24UL : \
+										 ((p) < MAX_LEVEL) ? 1520UL + ((p) - 67) * 24UL : (unsigned long)DUTY_OFF)
+#if DIMMING_CURVE == DIMMING_CURVE_LINEAR
+#define DIMMING_CURVE_LIGHT(p)			CURVE_LINEAR(p)
+#elif DIMMING_CURVE == DIMMING_CURVE_SQUARE
+#define DIMMING_CURVE_LIGHT(p)			CURVE_SQUARE(p)
+#elif DIMMING_CURVE == DIMMING_CURVE_CIE
+#define DIMMING_CURVE_LIGHT(p)			CURVE_CIE(p)
+#else
+#define DIMMING_CURVE_LIGHT(p)			CURVE_PIECEWISE(p)
+#endif
+#define DIMMING_CURVE_ENTRY(p)			(DUTY_OFF - DIMMING_CURVE_LIGHT(p))
+#define DIMMING_CURVE_ROW(p)			DIMMING_CURVE_ENTRY(p),     DIMMING_CURVE_ENTRY(p + 1), DIMMING_CURVE_ENTRY(p + 2), \
+										DIMMING_CURVE_ENTRY(p + 3), DIMMING_CURVE_ENTRY(p + 4), DIMMING_CURVE_ENTRY(p + 5), \
+										DIMMING_CURVE_ENTRY(p + 6), DIMMING_CURVE_ENTRY(p + 7), DIMMING_CURVE_ENTRY(p + 8), \
+										DIMMING_CURVE_ENTRY(p + 9)
 
 void UART_INIT();
 void CLOCK_INIT();
 void TIMER_INIT();
 void TIMER_DISABLE();
+void OCCUPANCY_TIMER_START();
+unsigned int low_power_mode();
 void REQUEST_MODE_TIMER_INIT();
 void REQUEST_MODE_TIMER_DISABLE();
 void FLASH_INIT();
 void PORT_INIT();
 void PORT_OUT_INIT();
 void PIR_INIT();
+void SUPPLY_MONITOR_INIT();
+void SUPPLY_SAMPLE();
 void SYS_INIT();
 void print_val1(unsigned int Value, unsigned int polling_host);
 void print_address(unsigned int isHostAddress);
@@ -147,95 +522,332 @@ void print_char(unsigned char character);
 void print_setting();
 void print_command(int lis_value);
 void flash_write();
+void config_write();
+void config_image(struct config *image);
+unsigned char config_changed();
+void meter_save();
+unsigned long config_long(const unsigned char *value);
+void config_set_long(unsigned char *value, unsigned long number);
+void config_store(const struct config *image);
 void flash_erase();
 unsigned char flash_read(unsigned int address);
+void flash_erase_segment(unsigned int address);
+void flash_program(unsigned int address, const unsigned char *data, unsigned char length);
+unsigned int config_sequence(unsigned int segment);
+unsigned char config_segments(unsigned int *order);
+unsigned int config_check(const unsigned char *data, unsigned char length);
+unsigned char config_record_length(unsigned int record, unsigned int end);
+unsigned int config_tail(unsigned int segment, unsigned int end);
+unsigned char config_base(const unsigned int *order, unsigned char segments);
+void config_load();
+void config_copy(unsigned char *destination, const unsigned char *source, unsigned char length);
+unsigned char config_append(unsigned char key, const struct config *image);
+unsigned char config_rotate(const unsigned int *order, unsigned char segments, const struct config *image);
+void config_write_header(unsigned int segment, unsigned int sequence);
+unsigned int table_segment();
+unsigned int table_record(unsigned int segment, unsigned char key);
+unsigned int table_find(unsigned char key);
+void table_write(const unsigned char *record, unsigned char length);
+unsigned char *table_pending_find(unsigned char key, unsigned char index);
+void table_change(unsigned char key, unsigned char index, unsigned char value0, unsigned char value1);
+void table_commit(unsigned char key);
+void tables_commit();
+void scene_read(unsigned int table, unsigned char scene, unsigned char *entry);
+void scene_entry(unsigned char scene, unsigned char *entry);
+void scene_write(unsigned char scene, const unsigned char *entry);
+void scene_command(unsigned char operation);
+void group_write(unsigned char group, unsigned char member);
+unsigned char group_member(unsigned char group);
 void set_duty_cycle(unsigned int Percentage_val);
+void start_fade();
+void set_duty_now(unsigned int duty);
+void start_identify();
+void pir_motion();
+EVENT_LIST(EVENT_PROTOTYPE)
 void get_ble_address();
+unsigned char ble_address_run_end();
+void uart_write(unsigned char character);
+unsigned char escape_byte(unsigned char value, unsigned char flag_bit, unsigned char *flags);
+void update_frame_header();
+void send_frame(unsigned char header, const unsigned char *payload, unsigned char length, unsigned char escaped_count);
+void dispatch_command();
+void dispatch_binary_frame(unsigned char length);
+void execute_command(unsigned char command);
+void run_command(unsigned char command);
+void commit_later();
+unsigned char command_refuses(unsigned char command, unsigned char value);
+void execute_batch(unsigned int crc);
+unsigned char group_address_match(unsigned char address);
+unsigned char rx_read();
+unsigned int crc16(const unsigned char *data, unsigned char length);
+unsigned char cobs_decode(unsigned char *buffer, unsigned char length, unsigned char delimiter);
+void send_cobs(const unsigned char *data, unsigned char length, unsigned char delimiter);
+void send_binary_frame(unsigned char header, const unsigned char *payload, unsigned char length);
+unsigned char find_command();
+unsigned char hex_to_nibble(unsigned char character);
+void parse_address(unsigned char *address, unsigned int *address_encrypted);
+COMMAND_LIST(COMMAND_PROTOTYPE, 0)
 
 int i = NULL;
-unsigned int j = NULL;
 static const char msg_arr[NO_OF_COMMANDS][MAX_CHAR] = {
 	"ADHxxxxx", "ADRxxxxx", "ADPxxxxx", "ADSSFxxx", "ADSTOxxx", "ADOPLxxx", "ADSPLxxx",	"ADFDRxxx", "ADFDDxxx", "ADSGPxxx", "ADSSNxxx", "ADGSNxxx",
 	"ADSTGxxx", "ADGTSNxx", "ADGGPNxx", "ADCLRSxx", "ADIDDEVx", "ADWRFLSx", "ADCMSETx", "ADCMRSTx", "ADGSD00x", "ADCLROSx", "ADLADONx", "ADLADOFx",
 	"ADDISOSx", "ADENAOSx", "ADGSF00x", "ADFTRSTx", "ADGSSETx", "ADERQOSx", "ADGTOOSx", "ADGPLADx",	"ADGNOGPx", "ADCLRGPx", "ADGGPLSx", "ADCRGPLx",
-	"ADGSTATx", "ADDROADx" };
+	"ADGSTATx", "ADDROADx", "ADGTXHWx", "ADBINMDx", "ADASCMDx",
+	"ADTxxxxx", "ADIDCxxx", "ADIDPxxx", "ADDBWxxx", "ADDBCxxx", "ADEVSxxx", "ADCMTxxx", "ADOCRxxx", "ADMTRxxx" };
+
+enum { COMMAND_LIST(COMMAND_POSITION, 0) COMMAND_COUNT };
+enum { COMMAND_LIST(COMMAND_SLOT_ENUM, 0) COMMAND_SLOT_END };
+STATIC_ASSERT(command_count_check, COMMAND_COUNT == NO_OF_COMMANDS);
+COMMAND_LIST(COMMAND_ORDER_CHECK, 0)
+STATIC_ASSERT(command_hash_perfect_0, COMMAND_SLOTS_UNIQUE(0));
+STATIC_ASSERT(command_hash_perfect_1, COMMAND_SLOTS_UNIQUE(1));
+STATIC_ASSERT(command_hash_perfect_2, COMMAND_SLOTS_UNIQUE(2));
+STATIC_ASSERT(command_hash_perfect_3, COMMAND_SLOTS_UNIQUE(3));
+
+/* Slot table resolved at compile time: opcode hash slot -> command index */
+static const unsigned char command_slot[COMMAND_TABLE_SIZE] = {
+	COMMAND_SLOT_ROW_8(0),   COMMAND_SLOT_ROW_8(8),   COMMAND_SLOT_ROW_8(16),  COMMAND_SLOT_ROW_8(24),
+	COMMAND_SLOT_ROW_8(32),  COMMAND_SLOT_ROW_8(40),  COMMAND_SLOT_ROW_8(48),  COMMAND_SLOT_ROW_8(56),
+	COMMAND_SLOT_ROW_8(64),  COMMAND_SLOT_ROW_8(72),  COMMAND_SLOT_ROW_8(80),  COMMAND_SLOT_ROW_8(88),
+	COMMAND_SLOT_ROW_8(96),  COMMAND_SLOT_ROW_8(104), COMMAND_SLOT_ROW_8(112), COMMAND_SLOT_ROW_8(120) };
+static const unsigned char command_length[NO_OF_COMMANDS] = { COMMAND_LIST(COMMAND_LENGTH, 0) };
+static void (* const command_handler[NO_OF_COMMANDS])() = { COMMAND_LIST(COMMAND_HANDLER, 0) };
+static const unsigned char command_parameter_length[NO_OF_COMMANDS] = { COMMAND_LIST(COMMAND_PARAMETERS, 0) };
+static const unsigned char command_batch[NO_OF_COMMANDS] = { COMMAND_LIST(COMMAND_BATCH, 0) };
+
+enum { EVENT_LIST(EVENT_POSITION) NO_OF_EVENTS };
+enum { EVENT_LIST(EVENT_BIT) EVENT_BIT_END };
+static void (* const event_handler[NO_OF_EVENTS])() = { EVENT_LIST(EVENT_HANDLER) };
+STATIC_ASSERT(event_bits_fit, NO_OF_EVENTS <= 8);
+STATIC_ASSERT(meter_light_fits, (255UL * METER_LIGHT_FULL) <= 0xFFFFUL);
+STATIC_ASSERT(meter_fits_binary, ((METER_COUNTERS * 4) + BINARY_RESPONSE_OVERHEAD) <= BINARY_RESPONSE_SIZE);
+
+/* Table log definitions
+ * The scene table and the group bitmap are too large for the configuration log, whose snapshot of struct config
+ * already fills an info segment. Each is one record in the format of that log, kept in two main flash segments reserved
+ * in the linker command file. A new table is appended to the newest segment. When it is full the other segment is
+ * erased, the table put in followed by the newest record of every other table, and its header, a sequence number as in
+ * the configuration log, written last.
+ */
+#define TABLE_FIRST_SEGMENT				0xC000										// TABLES in lnk_msp430g2553.cmd
+#define TABLE_SEGMENTS					2
+#define TABLE_SEGMENT_SIZE				512
+#define SCENE_TABLE						0x7E										// Record keys, below CONFIG_SNAPSHOT and above the config items
+#define GROUP_TABLE						0x7D
+#define NO_OF_TABLES					2
+#define TABLE_PENDING					4											// Table changes kept in RAM until the settings are written
+
+/* Scene 0 to F each hold a level with a relay off flag and a fade time. Before a table is first stored, scenes 1 to 5
+ * read from the former scenes of struct config.
+ */
+#define SCENES							16
+#define SCENE_ENTRY_SIZE				2											// Level and fade time in 100 ms, 0 uses the node fade
+#define SCENE_TABLE_SIZE				(SCENES * SCENE_ENTRY_SIZE)
+#define SCENE_RELAY_OFF					0x80										// Level flag, recalling the scene switches the load off
+#define SCENE_CLEARED					99											// Level of a scene never stored or cleared
+#define SCENE_FADE_STEP					100											// ms per fade time step
+#define SCENE_STORE						0
+#define SCENE_GET						1
+#define SCENE_RECALL					2
+#define SCENE_CLEAR						3
+
+/* Group membership, one bit for each of the groups 0 to 253. Frames are matched with a bit test on the bitmap in the
+ * table log after the changes not yet written. Until a bitmap is stored the former five groups of struct config are
+ * used, and the first bitmap written takes them in.
+ */
+#define GROUP_BITMAP_SIZE				32
+#define GROUP_NONE						0xFF										// Free slot in the former groups, never a group
+#define GROUP_BYTE(group)				((group) >> 3)
+#define GROUP_BIT(group)				(1 << ((group) & 7))
+
+STATIC_ASSERT(occupancy_cursor_fits, OCCUPANCY_SAMPLES <= 99);
+STATIC_ASSERT(occupancy_sample_unescaped, (OCCUPANCY_SAMPLE_FLAG | (OCCUPANCY_FRACTION_STEPS << OCCUPANCY_FRACTION_SHIFT) | OCCUPANCY_MOTIONS_MAX) < 254);
+STATIC_ASSERT(occupancy_chunk_fits_binary, (OCCUPANCY_CHUNK + 1 + BINARY_RESPONSE_OVERHEAD) <= BINARY_RESPONSE_SIZE);
+STATIC_ASSERT(occupancy_chunk_fits_mtu, (FRAME_ROUTE_LENGTH + OCCUPANCY_CHUNK + 1 + BINARY_RESPONSE_OVERHEAD + 2) <= BLE_MTU_PAYLOAD);
+
+enum { CONFIG_LIST(CONFIG_KEY) NO_OF_CONFIG_ITEMS };
+static const unsigned char config_offset[NO_OF_CONFIG_ITEMS] = { CONFIG_LIST(CONFIG_OFFSET) };
+static const unsigned char config_length[NO_OF_CONFIG_ITEMS] = { CONFIG_LIST(CONFIG_LENGTH) };
+static const unsigned int config_legacy_address[NO_OF_CONFIG_ITEMS] = { CONFIG_LIST(CONFIG_LEGACY_ADDRESS) };
+static const unsigned char config_legacy_step[NO_OF_CONFIG_ITEMS] = { CONFIG_LIST(CONFIG_LEGACY_STEP) };
+static const unsigned char config_version_size[CONFIG_VERSION + 1] = { 0, CONFIG_VERSION_1_SIZE, sizeof(struct config) };
+CONFIG_LIST(CONFIG_LENGTH_CHECK)
+STATIC_ASSERT(config_keys_fit, NO_OF_CONFIG_ITEMS < CONFIG_SNAPSHOT);
+STATIC_ASSERT(meter_keys_follow, (CONFIG_METER_ON_TIME == CONFIG_METER_ENERGY + METER_ON_TIME) && (CONFIG_METER_RELAY_CYCLES == CONFIG_METER_ENERGY + METER_RELAY_CYCLES));
+STATIC_ASSERT(table_keys_free, NO_OF_CONFIG_ITEMS < GROUP_TABLE);
+STATIC_ASSERT(tables_fit, (CONFIG_HEADER_SIZE + (2 * CONFIG_RECORD_OVERHEAD) + SCENE_TABLE_SIZE + GROUP_BITMAP_SIZE) <= TABLE_SEGMENT_SIZE);
+STATIC_ASSERT(config_fits_segment, (CONFIG_HEADER_SIZE + sizeof(struct config) + CONFIG_MAX_LENGTH + (2 * CONFIG_RECORD_OVERHEAD)) <= CONFIG_SEGMENT_SIZE);
+
+/* Settings of a node that has never written them */
+static const struct config config_defaults = {
+	CONFIG_VERSION,
+	15,																		// sensing_freq
+	15,																		// time_out
+	{'1','2','3','4'},														// host_address
+	RESET,																	// commissioning_flag
+	1,																		// fade_rate
+	{3, 0},																	// fade_delay
+	99,																		// power_on_value
+	{99, 99, 99, 99, 99},													// scenes
+	{0xff, 0xff, 0xff, 0xff, 0xff},											// groups
+	OFF,																	// lis_mode
+	NULL,																	// lis_group_number
+	{'4','3','2','1'},														// polling_host_address
+	{0, 0},																	// fade_time
+	NULL,																	// commit_idle
+	{0, 0, 0, 0},															// meter_energy
+	{0, 0, 0, 0},															// meter_on_time
+	{0, 0, 0, 0} };															// meter_relay_cycles
+static const unsigned int dimming_curve[DIMMING_LEVELS] = {
+	DIMMING_CURVE_ROW(0),  DIMMING_CURVE_ROW(10), DIMMING_CURVE_ROW(20), DIMMING_CURVE_ROW(30), DIMMING_CURVE_ROW(40),
+	DIMMING_CURVE_ROW(50), DIMMING_CURVE_ROW(60), DIMMING_CURVE_ROW(70), DIMMING_CURVE_ROW(80), DIMMING_CURVE_ROW(90) };
+STATIC_ASSERT(dimming_curve_ends, (DIMMING_CURVE_ENTRY(0) == DUTY_OFF) && (DIMMING_CURVE_ENTRY(MAX_LEVEL) == 0));
+static const unsigned int crc16_table[16] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7, 0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF };
 
 static const char send_msg[SEND_MSG_LENGTH] = {"D "};
 static const char LIS_command[5] = {'A', 'D', 'S', 'P', 'L'};
-unsigned char character_count = NULL;
+unsigned char character_count = NULL;										// Characters of the frame being received
 unsigned int checksum;
 unsigned char msb = NULL, lsb = NULL, input_val = NULL;
 unsigned int timer_count = NULL;
 unsigned char BLE_address[4];
 unsigned int BLE_address_encrypted[2];
 unsigned char HOST_address[4] = {'1','2','3','4'};
-unsigned int HOST_address_ASCII[4];
 unsigned int HOST_address_encrypted[2];
 unsigned char POLLING_HOST_address[4] = {'4','3','2','1'};
-unsigned int POLLING_HOST_address_ASCII[4];
 unsigned int POLLING_HOST_address_encrypted[2];
 
-unsigned char iteration = 3;
-unsigned char iteration1 = 5;
 unsigned char pir_flag = 0;
-unsigned char pir_count = 0;
+unsigned char pir_window = 20;												// PIR debounce window in samples
+unsigned char pir_confirm = 4;												// High samples within the window that confirm motion
+volatile unsigned char pir_samples = NULL;									// Samples left in the running debounce, 0 when idle
+unsigned char pir_high_count;												// High samples seen in the running debounce
 unsigned char received_char = 0;
 
 /* Flags */
 unsigned char request_mode_flag = 1;
 unsigned char ping_flag;
-unsigned char timer_flag;
 unsigned int sensing_freq = 15;
-unsigned int present_percentage;
 unsigned int present_count = 0;
 unsigned int timer_count_1 = NULL;
-unsigned long sensing_freq_val;
+unsigned int sensing_freq_val;
 unsigned char commissioning_flag = 0;
-unsigned char no_of_groups = 0;
-unsigned char group_array[5] = {0xff, 0xff, 0xff, 0xff, 0xff};
-unsigned char group_match = false;
-unsigned char group_array_index = 0;
-unsigned int group_address_encrypted[3];
-unsigned char scene_number = NULL;
-unsigned char go_to_scene = 0xff;
-unsigned char get_scene_number = 0;
-unsigned char scene_one = 99;
-unsigned char scene_two = 99;
-unsigned char scene_three = 99;
-unsigned char scene_four = 99;
-unsigned char scene_five = 99;
+const unsigned char *group_bitmap = NULL;									// Group bits in the table log, NULL when none are stored
+unsigned char table_pending[TABLE_PENDING][4];								// Table changes not yet written: key, scene or group, values
+unsigned char table_changes = NULL;											// Entries of table_pending in use
 unsigned char store_group_value;
-unsigned char lis_on_send_flag = false;
 unsigned char lis_mode = OFF;
 
 /* Occupancy Sensor variables */
-unsigned long timer_int_count = NULL;										// timer interrupt entry count
-unsigned char time_out_flag = NO;
-unsigned long max_timer_count = _15_MIN;									// timer count for 15 min default
+unsigned int timer_int_count = NULL;											// occupancy time out checkpoints so far
+unsigned int max_timer_count;												// checkpoint count of the occupancy time out
+unsigned int vlo_frequency = VLO_NOMINAL_HZ;								// Measured ACLK frequency
+volatile unsigned char occupancy_timer_on = NO;								// Checkpoints count the occupancy time out
+volatile unsigned char sensing_timer_on = NO;								// Checkpoints count the sensing frequency
 unsigned char received_val[MAX_CHAR];										// received chararcter array through UART
-unsigned long time_out = NULL;
+unsigned int time_out = NULL;
 unsigned char temp_delay[2] = {3, 0};
-unsigned long delay_value = 300;
-unsigned long long_delay;
+unsigned int delay_value = 300;
 unsigned char sensor_there = false;
 
 /* PWM generation variables */
-unsigned int current_duty = NULL;
 unsigned int target_duty = NULL;
 int fade_rate_val = 1;
-int flash_fade_rate_val;
 int percentage_val = 99;
-unsigned int percent_normalize;
-unsigned int case_value;
 unsigned char power_on_value = 99;
 unsigned char isOff = false;
 unsigned char pirOff = true;
-unsigned char char_change_flag = UNITY;
 unsigned int command_index_match = 255;
-unsigned char junk = NULL;
+volatile unsigned char fade_active = NO;									// CCR1 is moving towards fade_target in Timer_A
+unsigned int fade_target = NULL;											// target_duty of the last fade started
+unsigned char fade_dim_down = NO;											// CCR1 is increasing
+unsigned long fade_position;												// CCR1 in fixed point
+unsigned long fade_increment;												// Fixed point change per PWM period
+unsigned int fade_periods;													// PWM periods left in the fade
+unsigned int fade_time = NULL;												// Fade duration in ms, 0 uses fade_rate_val and delay_value
+unsigned char scene_fade = NULL;											// Fade time of a recalled scene for the next fade only, 0 uses fade_time
+unsigned char identify_count = 1;											// Blinks per ADIDDEV
+unsigned char identify_period = 20;											// Blink period in 100 ms
+volatile unsigned char identify_phases = NULL;								// Half blinks left, 0 when not identifying
+unsigned int identify_ticks;												// PWM periods left in the present half blink
+unsigned int identify_duty;													// CCR1 and relay state restored after identifying
+unsigned char identify_relay;
+
+/* UART transmit queue, drained by USCI0TX_ISR */
+unsigned char tx_buffer[TX_BUFFER_SIZE];
+volatile unsigned char tx_head = 0;
+volatile unsigned char tx_tail = 0;
+unsigned char tx_high_water = 0;											// Highest number of queued bytes seen
+
+/* UART receive queue, filled with complete frames by USCI0RX_ISR */
+unsigned char rx_buffer[RX_BUFFER_SIZE];
+volatile unsigned char rx_head = 0;											// Next free byte, owned by USCI0RX_ISR
+volatile unsigned char rx_frame_start = 0;									// First byte of the frame being received
+volatile unsigned char rx_tail = 0;											// Next byte to be read, owned by main
+volatile unsigned char rx_frames_received = 0;
+volatile unsigned char pending_events = NULL;								// EVENT_ bits posted by the interrupts
+unsigned int event_runs[NO_OF_EVENTS];										// Handler runs per event
+unsigned int event_max_cycles[NO_OF_EVENTS];								// Longest handler run per event in MCLK cycles
+unsigned char rx_frames_handled = 0;
+unsigned char rx_overruns = 0;												// Frames dropped because the queue was full
+volatile unsigned char ble_address_count = 0;
+volatile unsigned char ble_address_wait = NULL;								// Checkpoints left for the BLE address reply, 0 when not waiting
+unsigned char ble_address_tries = NULL;										// Requests left before the BLE address is given up
+unsigned char ble_address_reply = NO;										// ADDROAD is answered once the address is known
+volatile unsigned int pir_warm_up = NULL;									// Checkpoints left before PIR motion is believed
+unsigned char rx_binary_frame = NO;											// Frame being received is COBS encoded
+unsigned char rx_crc_errors = 0;											// Binary frames dropped because of a bad CRC
+
+/* Deferred configuration commit */
+struct config config;														// Settings as they are in the flash
+unsigned char commit_idle = NULL;											// Seconds without a setting command before the settings are written, 0 waits for ADWRFLS
+unsigned char config_dirty = NO;											// Settings changed since the last flash write
+volatile unsigned int commit_countdown = NULL;								// Checkpoints left before the automatic flash write, 0 when none is due
+unsigned char supply_monitor = NO;											// VCC measured every checkpoint
+volatile unsigned char supply_low = NO;										// Supply sag seen, the monitor is re-armed once it recovers
+
+/* Occupancy history */
+unsigned char occupancy_history[OCCUPANCY_SAMPLES];							// Sample ring, oldest at occupancy_head once full
+unsigned char occupancy_head = NULL;										// Next sample to be written
+unsigned char occupancy_samples = NULL;										// Samples kept
+unsigned char occupancy_minutes = NULL;										// Minutes of the running interval
+unsigned char occupancy_occupied = NULL;									// Occupied minutes of the running interval
+volatile unsigned char occupancy_motions = NULL;							// Debounced PIR motions in the running interval
+
+/* Minute statistics */
+unsigned char minute_interval;												// Checkpoints per minute
+volatile unsigned char minute_checkpoints = NULL;							// Checkpoints of the running minute
+volatile unsigned char minute_occupied = NULL;								// Checkpoints with the occupancy time out running
+volatile unsigned char minute_relay_on = NULL;								// Checkpoints with the relay on
+volatile unsigned char minute_relay_starts = NULL;							// Relay switched on since the last checkpoint
+volatile unsigned int minute_light = NULL;									// Light output, METER_LIGHT_FULL per checkpoint at full light
+unsigned char relay_was_on = NO;											// Relay state at the last checkpoint
+
+/* Energy meter, the totals last written are in config */
+unsigned int meter_counts[METER_COUNTERS];									// Counts not yet written, by METER_ counter
+unsigned char meter_minutes = NULL;											// Minutes since the meter was last written
+
+/* Binary protocol */
+unsigned char protocol_mode = ASCII_PROTOCOL;								// Response format, ASCII after every reset
+unsigned char current_command = NO_COMMAND;									// Command being executed, echoed in binary responses
+unsigned char binary_frame[BINARY_FRAME_SIZE];
+unsigned char response_muted = NO;											// Set while the commands of a batch run
+unsigned int batch_crc;														// CRC of the last batch, to ignore a repeated one
+
+/* Response header cache, rebuilt by update_frame_header() */
+unsigned char frame_header[2][FRAME_HEADER_LENGTH];
+unsigned char frame_header_flag = UNITY;
+unsigned int frame_header_checksum;
 
 void main(void)
 {
+	unsigned char events;
+	unsigned char event;
+	unsigned int start;
+	unsigned int cycles;
+
 	WDTCTL = WDTPW | WDTHOLD;												// Stop watchdog timer
 	CLOCK_INIT();
 	UART_INIT();
@@ -244,35 +856,17 @@ void main(void)
 	PORT_OUT_INIT();
 	SYS_INIT();
 
-	/* Dim down */
-	if (target_duty > current_duty)
+	/* Dim down to the power on level while the sensor initialises */
+	if(CCR1 != target_duty)
 	{
-		for (i = current_duty; i <= target_duty; i += fade_rate_val)
-		{
-			CCR1 += fade_rate_val;
-			if(CCR1 >= target_duty + 1)
-			{
-				CCR1   = target_duty;
-				if(isOff == true)
-				{
-					P2OUT &= ~BIT2;
-				}
-				break;
-			}
-			for(j=0; j<delay_value; j++)
-			{
-				__delay_cycles(1);
-			}
-		}
+		start_fade();
 	}
-	current_duty = target_duty;
+	pir_warm_up = CHECKPOINTS(PIR_WARM_UP) + 1;								// PIR motion is ignored until the sensor has settled
+	__bis_SR_register(GIE);
 
-	for(i=0; i<5; i++)
-	{
-		__delay_cycles(8000000);											// Wait for 15 seconds for sensor to initaialize
-	}
-
-	get_ble_address();
+	update_frame_header();													// Commands answered before the BLE address is known
+	ble_address_tries = BLE_ADDRESS_TRIES;
+	get_ble_address();														// Answered in handle_ble_address()
 
 	PORT_INIT();																// Initialise the I/O peripherals
 	REQUEST_MODE_TIMER_INIT();													// Initialise timer for uart mode and request mode operation
@@ -291,1510 +885,2481 @@ void main(void)
 
 	while(true)
 	{
-		__bis_SR_register(LPM0_bits + GIE);
-
-		if(lis_on_send_flag == true)
+		__disable_interrupt();
+		events = pending_events;
+		pending_events = NULL;
+		if(events == NULL)
 		{
-			lis_on_send_flag = false;
-			print_command(true);
+			__bis_SR_register(low_power_mode() + GIE);						// Sleep until an interrupt posts an event
+			TA0CCTL1 = OUTMOD_3;											// Back to PWM if the output was held for LPM3
+			continue;
 		}
+		__enable_interrupt();
 
-		/* Timer indication of 15s timeout to detect the motion for analytics*/
-		if(request_mode_flag == YES)
+		for(event = NULL; event < NO_OF_EVENTS; event++)
 		{
-			if (timer_flag == YES)
+			if(events & (1 << event))
 			{
-				timer_flag = NO;
-				if (pir_flag == YES)											// Check whether motion detected
+				start = TA1R;
+				event_handler[event]();
+				cycles = (TA1R - start) & 0xFFFF;
+				event_runs[event]++;
+				if(cycles > event_max_cycles[event])
 				{
-					present_count++;
-					if (present_count >= 255)
-						present_count = NULL;
-					pir_flag = NO;												// Clear PIR flag
+					event_max_cycles[event] = cycles;
 				}
 			}
 		}
+	}
+}
 
-		if(time_out_flag == YES)										// Timeout indication for occupancy sensor to turn off the load
-		{
-			P2OUT &= ~BIT2;												// switch off all the lights
-			pirOff = 1;
-//			__delay_cycles(_0_5_SEC_COUNT);
-			P1IFG &= ~BIT5;												// clear interrupt flag to avoid flase trigger because of relay noise
-			time_out_flag = NO;
-			TIMER_DISABLE();
-			print_command(false);
-		}
+/* EVENT_UART_FRAME - Processes the UART command requests */
+void handle_uart_frames()
+{
+	unsigned char frame_length;
 
-		if(character_count == MAX_CHAR)													// Processes the UART command request
+	while(rx_frames_handled != rx_frames_received)
+	{
+		frame_length = rx_read();
+		if((frame_length & BINARY_FRAME_FLAG) == 0)
 		{
-			character_count = NULL;
-			IE2 &= ~UCA0RXIE;
-			for(i=NULL; i<5; i++)
+			for(i=NULL; i<MAX_CHAR; i++)
 			{
-				if((received_val[7] == BROADCAST_ADDRESS) || (received_val[7] == group_array[i]))
-				{
-					group_match = true;
-					break;
-				}
+				received_val[i] = rx_read();										// Take the frame out of the queue
 			}
-			if(group_match == true)
+			rx_frames_handled++;
+			if(group_address_match(received_val[7]) == true)
 			{
 				timer_count = NULL;
-
-				for(j=NULL; j<NO_OF_COMMANDS; j++)
-				{
-					for(i=NULL; i<(MAX_CHAR-1); i++)
-					{
-						if(received_val[i] == msg_arr[j][i])
-						{
-							if((i == LAST_CHAR) && (j == IDENTIFY_DEVICE) && (command_index_match != IDENTIFY_DEVICE))
-							{
-								/* ADIDDEV */
-								print_char('s');															// Send acknowledgement
-								P2OUT 				|= BIT2;												// Switch ON load
-								__delay_cycles(8000000);													// Delay of 1 second
-								P2OUT 				&= ~BIT2;												// Switch OFF load
-								__delay_cycles(8000000);													// Delay of 1 second
-								P2OUT 				|= BIT2;												// Switch ON load
-								P1IFG 				&= ~BIT5;												// Clear the interrupt flag
-								command_index_match = IDENTIFY_DEVICE;
-								j 					= NO_OF_COMMANDS;										// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == FLASH_WRITE) && (command_index_match != FLASH_WRITE))
-							{
-								/* ADWRFLS */
-								print_char('s');												// Send acknowledgement
-								flash_write();																// Write to flash memory
-								command_index_match = FLASH_WRITE;
-								j 					= NO_OF_COMMANDS;												// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == SET_COMMISSIONING_FLAG) && (command_index_match != SET_COMMISSIONING_FLAG))
-							{
-								/* ADCMSET */
-								print_char('s');												// Send acknowledgement
-								commissioning_flag = YES;										// Set the commissioning flag
-								command_index_match = SET_COMMISSIONING_FLAG;
-								j 					= NO_OF_COMMANDS;												// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == RESET_COMMISSIONING_FLAG) && (command_index_match != RESET_COMMISSIONING_FLAG))
-							{
-								/* ADCMRST */
-								print_char('s');												// Send acknowledgement
-								commissioning_flag = NO;										// Reset the commissioning flag
-								command_index_match = RESET_COMMISSIONING_FLAG;
-								j 					= NO_OF_COMMANDS;												// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == GET_SENSOR_DATA) && (command_index_match != GET_SENSOR_DATA))
-							{
-								/* ADGSD00 */
-								print_val1(present_count+1,2);									// Send the count of movement
-								command_index_match = GET_SENSOR_DATA;
-								j 					= NO_OF_COMMANDS;												// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == CLEAR_COUNT) && (command_index_match != CLEAR_COUNT))
-							{
-								/* ADCLROS */
-								print_char('s');												// Send acknowledgement
-								present_count 		= NULL;											// Clear the count value
-								command_index_match = CLEAR_COUNT;
-								j 					= NO_OF_COMMANDS;												// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == RELAY_ON) && (command_index_match != RELAY_ON))
-							{
-								/* ADLADON */
-								print_char('s');												// Send acknowledgement
-								P2OUT 				|= BIT2;													// Switch on all lights
-								P1IE 				&= ~BIT5;													// Disable PIR sensor interrupt
-								timer_int_count 	= NULL;											// Clear occupancy sensor timer count
-								timer_count_1 		= NULL;											// Clear sensing frequecy timer count
-								isOff 				= false;
-								target_duty 		= NULL;
-								CCR1 				= NULL;
-								sensor_there		= false;
-								TIMER_DISABLE();												// Disable occupancy sensor timer
-								REQUEST_MODE_TIMER_DISABLE();									// Disable request mode timer
-								command_index_match = RELAY_ON;
-								j 					= NO_OF_COMMANDS;												// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == RELAY_OFF) && (command_index_match != RELAY_OFF))
-							{
-								/* ADLADOF */
-								print_char('s');												// Send acknowledgement
-								P2OUT 				&= ~BIT2;													// switch off all lights
-								P1IE 				&= ~BIT5;													// Disable PIR sensor interrupt
-								timer_int_count 	= NULL;											// Clear occupancy sensor timer count
-								timer_count_1 		= NULL;											// Clear sensing frequecy timer count
-								isOff 				= true;
-								target_duty 		= 3300;
-								CCR1 				= 3300;
-								sensor_there 		= false;
-								TIMER_DISABLE();												// Disable occupancy sensor timer
-								REQUEST_MODE_TIMER_DISABLE();									// Disable request mode timer
-								command_index_match = RELAY_OFF;
-								j 					= NO_OF_COMMANDS;												// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == DISABLE_OS) && (command_index_match != DISABLE_OS))
-							{
-								/* ADDISOS */
-								print_char('s');												// Send acknowledgement
-								P1IE 				&= ~BIT5;													// Disable the PIR sensor interrupt
-								sensor_there 		= false;
-								lis_mode			= OFF;
-								TIMER_DISABLE();												// Disable occupancy sensor timer
-								REQUEST_MODE_TIMER_DISABLE();									// Disable request mode timer
-								command_index_match = DISABLE_OS;
-								j 					= NO_OF_COMMANDS;												// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == ENABLE_OS) && (command_index_match != ENABLE_OS))
-							{
-								/* ADENAOS */
-								print_char('s');												// Send acknowledgement
-								PIR_INIT();
-								sensor_there		= true;
-								lis_mode			= ON;
-								TIMER_INIT();													// Enable occupancy sensor timer
-								REQUEST_MODE_TIMER_INIT();										// Enable request mode timer
-								command_index_match = ENABLE_OS;
-								j 					= NO_OF_COMMANDS;												// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == GET_SENSING_FREQ) && (command_index_match != GET_SENSING_FREQ))
-							{
-								/* ADGSF00 */
-								print_val1(sensing_freq,2);										// Send the sensing frequency value
-								command_index_match = GET_SENSING_FREQ;
-								j 					= NO_OF_COMMANDS;												// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == FACTORY_RESET) && (command_index_match != FACTORY_RESET))
-							{
-								/* ADFTRST */
-								print_char('s');												// Send acknowledgement
-								P1IE 				&= ~BIT5;													// Disable the PIR sensor interrupt
-								sensor_there 		= false;
-								lis_mode			= false;
-								pir_flag 			= NO;													// Clear the PIR flag
-								present_count 		= NULL;											// Clear the present count
-								sensing_freq 		= 15;
-								sensing_freq_val 	= (15 * 1000000)/8192;							// Set the sensing frequency to 15s
-								timer_int_count 	= NULL;											// Clear occupancy sensor timer count
-								timer_count_1 		= NULL;											// Clear sensing frequecy timer count
-								max_timer_count 	= _15_MIN;										// Set max_timer_count value to 15 mins
-								time_out 			= max_timer_count / _1_MIN;							// Calculate the occupancy sensor time out value
-								P2OUT 			   	|= BIT2;													// Switch ON the load
-								target_duty 		= NULL;
-								CCR1 				= RESET;
-								isOff 				= false;
-								pirOff 				= true;
-								power_on_value 		= 99;
-								delay_value 		= 300;
-								temp_delay[0] 		= 3;
-								temp_delay[1] 		= 0;
-								fade_rate_val 		= 1;
-								commissioning_flag 	= RESET;
-
-								for(i=0;i<5;i++)
-								{
-									group_array[i]  = 0xff;
-								}
-
-								scene_one			= 99;
-								scene_two			= 99;
-								scene_three			= 99;
-								scene_four			= 99;
-								scene_five			= 99;
-								scene_number		= 0;
-								TIMER_INIT();													// Enable occupancy sensor timer & set pwm output mode
-								TIMER_DISABLE();												// Disable occupancy sensor timer
-								REQUEST_MODE_TIMER_DISABLE();									// Disable request mode timer
-								flash_erase();													// Write into flash memory
-								command_index_match = FACTORY_RESET;
-								j 					= NO_OF_COMMANDS;												// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == GET_SENSOR_SETTINGS) && (command_index_match != GET_SENSOR_SETTINGS))
-							{
-								/* ADGSSET */
-								print_setting();												// Send sensing frequency and time out value
-								command_index_match = GET_SENSOR_SETTINGS;
-								j 					= NO_OF_COMMANDS;												// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == ENABLE_REQ_MODE) && (command_index_match != ENABLE_REQ_MODE))
-							{
-								/* ADERQOS */
-								print_char('s');												// Send acknowledgement
-								request_mode_flag 	= YES;
-								PIR_INIT();
-								pir_flag 			= NO;													// Clear pir_flag
-								P2OUT 				|= BIT2;													// Switch ON load
-								target_duty 		= NULL;
-								isOff 				= false;
-								power_on_value 		= 99;
-								delay_value 		= 300;
-								temp_delay[0] 		= 3;
-								temp_delay[1] 		= 0;
-								fade_rate_val 		= 1;
-								sensor_there 		= true;
-								lis_mode			= ON;
-
-								TIMER_INIT();													// Start 15s and occupancy sensor timer
-								REQUEST_MODE_TIMER_INIT();										// Start 15s request mode timer
-								command_index_match = ENABLE_REQ_MODE;
-								j 					= NO_OF_COMMANDS;												// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == GET_TIMEOUT_VAL) && (command_index_match != GET_TIMEOUT_VAL))
-							{
-								/* ADGTOOS */
-								time_out 			= max_timer_count / _1_MIN;							// Calculate the time out value
-								print_val1(time_out,2);											// Send time out value
-								command_index_match = GET_TIMEOUT_VAL;
-								j 					= NO_OF_COMMANDS;												// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == GET_PERCENTAGE_LEVEL) && (command_index_match != GET_PERCENTAGE_LEVEL))
-							{
-								/* ADGPLAD */
-								print_val1(percentage_val,2);												// Send acknowledgement
-								command_index_match = GET_PERCENTAGE_LEVEL;
-								j 					= NO_OF_COMMANDS;												// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == GET_NO_OF_GROUPS) && (command_index_match != GET_NO_OF_GROUPS))
-							{
-								/* ADGNOGP */
-								no_of_groups = 0;
-								for(i=0; i<5; i++)
-								{
-									if(group_array[i] != 0xff)
-									{
-										no_of_groups++;
-									}
-								}
-								print_val1(no_of_groups,2);
-								command_index_match = GET_NO_OF_GROUPS;
-								j 					= NO_OF_COMMANDS;  											// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == CLEAR_GROUP) && (command_index_match != CLEAR_GROUP))
-							{
-								/* ADCLRGP */
-								print_char('s');
-								for(i=NULL; i<5; i++)
-								{
-									if(received_val[7] == group_array[i])
-									{
-										group_array[i] = 0xff;
-									}
-								}
-								command_index_match = CLEAR_GROUP;
-								j 					= NO_OF_COMMANDS;  											// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == GET_LIS_GROUP) && (command_index_match != GET_LIS_GROUP))
-							{
-								/* ADGGPLS */
-								print_val1(store_group_value,2);
-								command_index_match = GET_LIS_GROUP;
-								j 					= NO_OF_COMMANDS;  											// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == CLEAR_LIS_GROUP) && (command_index_match != CLEAR_LIS_GROUP))
-							{
-								/* ADCRGPL */
-								print_char('s');
-								store_group_value 	= 0xff;
-								command_index_match = CLEAR_LIS_GROUP;
-								j 					= NO_OF_COMMANDS;  											// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == GET_HEALTH_STATUS) && (command_index_match != GET_HEALTH_STATUS))
-							{
-								/* ADGSTAT */
-								print_val1(percentage_val,1);												// Send acknowledgement
-								command_index_match = GET_HEALTH_STATUS;
-								j 					= NO_OF_COMMANDS;  											// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i == LAST_CHAR) && (j == RECEIVE_OWN_ADDRESS) && (command_index_match != RECEIVE_OWN_ADDRESS))
-							{
-								/* ADDROAD */
-								get_ble_address();
-								print_address(2);
-								command_index_match = RECEIVE_OWN_ADDRESS;
-								j 					= NO_OF_COMMANDS;  											// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-						}
-						else
-						{
-							if((i == 3) && (j == SET_HOST_ADDRESS) && (commissioning_flag == 0) && (command_index_match != SET_HOST_ADDRESS))		// Change host address if sensor is not commissioned
-							{
-								/* ADHxxxx */
-								for(i=NULL; i<4; i++)
-								{
-									HOST_address[i] 	  = received_val[iteration++];				// Store the address in the HOST_address variable
-								}
-								for(i=0; i<4; i++)
-								{
-									if (HOST_address[i] >= '0' && HOST_address[i] <= '9')
-									{
-										HOST_address_ASCII[i] = HOST_address[i] - ASCII_0;
-									}
-									else if (HOST_address[i] >= 'A' && HOST_address[i] <= 'F' )
-									{
-										HOST_address_ASCII[i] = HOST_address[i] - ASCII_UP_CASE;
-									}
-									else if (HOST_address[i] >= 'a' && HOST_address[i] <= 'f' )
-									{
-										HOST_address_ASCII[i] = HOST_address[i] - ASCII_LOW_CASE;
-									}
-								}
-								HOST_address_encrypted[0] = (HOST_address_ASCII[0] << 4) + HOST_address_ASCII[1];
-								HOST_address_encrypted[1] = (HOST_address_ASCII[2] << 4) + HOST_address_ASCII[3];
-								iteration 				  = 3;
-								print_address(2);
-								command_index_match 	  = SET_HOST_ADDRESS;
-								j 						  = NO_OF_COMMANDS;
-								i 						  = MAX_CHAR;
-							}
-							else if((i == 3) && (j == RESET_HOST_ADDRESS) && (command_index_match != RESET_HOST_ADDRESS))
-							{
-								/* ADRxxxx */
-								for(i=NULL; i<4; i++)
-								{
-									HOST_address[i] 	= received_val[iteration++];
-								}
-								for(i=0; i<4; i++)
-								{
-									if (HOST_address[i] >= '0' && HOST_address[i] <= '9')
-									{
-										HOST_address_ASCII[i] = HOST_address[i] - ASCII_0;
-									}
-									else if (HOST_address[i] >= 'A' && HOST_address[i] <= 'F' )
-									{
-										HOST_address_ASCII[i] = HOST_address[i] - ASCII_UP_CASE;
-									}
-									else if (HOST_address[i] >= 'a' && HOST_address[i] <= 'f' )
-									{
-										HOST_address_ASCII[i] = HOST_address[i] - ASCII_LOW_CASE;
-									}
-								}
-								HOST_address_encrypted[0] = (HOST_address_ASCII[0] << 4) + HOST_address_ASCII[1];
-								HOST_address_encrypted[1] = (HOST_address_ASCII[2] << 4) + HOST_address_ASCII[3];
-								iteration 				= 3;
-								print_address(2);
-								command_index_match 	= RESET_HOST_ADDRESS;
-								j 						= NO_OF_COMMANDS;
-								i 						= MAX_CHAR;
-							}
-							else if((i == 3) && (j == POLLING_HOST_ADDRESS) && (command_index_match != POLLING_HOST_ADDRESS))
-							{
-								/* ADPxxxx */
-								for(i=NULL; i<4; i++)
-								{
-									POLLING_HOST_address[i] 	= received_val[iteration++];
-								}
-								for(i=0; i<4; i++)
-								{
-									if (POLLING_HOST_address[i] >= '0' && POLLING_HOST_address[i] <= '9')
-									{
-										POLLING_HOST_address_ASCII[i] = POLLING_HOST_address[i] - ASCII_0;
-									}
-									else if (POLLING_HOST_address[i] >= 'A' && POLLING_HOST_address[i] <= 'F' )
-									{
-										POLLING_HOST_address_ASCII[i] = POLLING_HOST_address[i] - ASCII_UP_CASE;
-									}
-									else if (POLLING_HOST_address[i] >= 'a' && POLLING_HOST_address[i] <= 'f' )
-									{
-										POLLING_HOST_address_ASCII[i] = POLLING_HOST_address[i] - ASCII_LOW_CASE;
-									}
-								}
-								POLLING_HOST_address_encrypted[0] = (POLLING_HOST_address_ASCII[0] << 4) + POLLING_HOST_address_ASCII[1];
-								POLLING_HOST_address_encrypted[1] = (POLLING_HOST_address_ASCII[2] << 4) + POLLING_HOST_address_ASCII[3];
-								iteration 				= 3;
-								print_address(1);
-								command_index_match 	= POLLING_HOST_ADDRESS;
-								j 						= NO_OF_COMMANDS;
-								i 						= MAX_CHAR;
-							}
-							else if((i == 5) && (j == SET_FADE_DELAY_VALUE) && (command_index_match != SET_FADE_DELAY_VALUE))
-							{
-								/* ADFDDxx */
-								print_char('s');
-								for(i=NULL; i<2; i++)
-								{
-									temp_delay[i] 		= received_val[iteration1++];
-									temp_delay[i] 		= temp_delay[i] - ASCII_0;
-								}
-								iteration1 				= 5;
-								delay_value 			= ((temp_delay[0] * 10) + (temp_delay[1] * 1)) * 10;
-								command_index_match 	= SET_FADE_DELAY_VALUE;
-								j			 			= NO_OF_COMMANDS;									// Break out of both the for loops
-								i 						= MAX_CHAR;
-							}
-							else if((i == 5) && (j <= INPUT_VAL_COMMANDS))
-							{
-								msb 					= received_val[MSB];								// retreive MSB from the command
-								lsb 					= received_val[LSB];								// retreive LSB from the command
-								lsb 					= lsb - ASCII_0;									// get the actual value after subtracting the ascii 0
-								msb 					= msb - ASCII_0;
-								input_val 				= (msb * TEN) + lsb;							// get the actual number
-								if((j == SET_TIMEOUT) && (command_index_match != SET_TIMEOUT))
-								{
-									/* ADSTOxx */
-									print_char('s');
-									time_out 			= input_val;								// Store the number in time_out variable
-									timer_int_count 	= NULL;
-									max_timer_count 	= time_out * _1_MIN;				// Convert the number into count value
-									command_index_match = SET_TIMEOUT;
-									j 					= NO_OF_COMMANDS;									// Break out of both the for loops
-									i 					= MAX_CHAR;
-								}
-								else if((j == SET_SENSING_FREQ) && (command_index_match != SET_SENSING_FREQ))
-								{
-									/* ADSSFxx */
-									print_char('s');
-									sensing_freq 		= input_val;							// Store the number in sensing_freq variable
-									sensing_freq_val 	= ((sensing_freq * 1000000)/8192);		// Convert the number into sensing frequency value count
-									timer_count_1 		= NULL;								// Clear the sensing frequency timer count
-									timer_flag 			= NO;									// Reset the sensing frequency timer flag
-									command_index_match = SET_SENSING_FREQ;
-									j = NO_OF_COMMANDS;									// Break out of both the for loops
-									i = MAX_CHAR;
-								}
-								else if((j == SET_POWER_ON_LEVEL) && (command_index_match != SET_POWER_ON_LEVEL))
-								{
-									/* ADOPLxx Power On Level*/
-									print_char('s');
-									power_on_value 		= input_val;
-									command_index_match = SET_POWER_ON_LEVEL;
-									j 					= NO_OF_COMMANDS;									// Break out of both the for loops
-									i 					= MAX_CHAR;
-								}
-								else if((j == SET_PERCENTAGE_LEVEL) && (command_index_match != SET_PERCENTAGE_LEVEL))
-								{
-									/* ADSPLxx */
-									print_char('s');
-									percentage_val 		= input_val;
-									set_duty_cycle(percentage_val);
-									command_index_match = SET_PERCENTAGE_LEVEL;
-									j 					= NO_OF_COMMANDS;									// Break out of both the for loops
-									i 					= MAX_CHAR;
-								}
-								else if((j == SET_FADE_RATE_VALUE) && (command_index_match != SET_FADE_RATE_VALUE))
-								{
-									/* ADFDRxx */
-									print_char('s');
-									fade_rate_val 		= input_val;
-									command_index_match = SET_FADE_RATE_VALUE;
-									j					= NO_OF_COMMANDS;									// Break out of both the for loops
-									i 					= MAX_CHAR;
-								}
-								else if((j == SET_GROUP_NUMBER) && (command_index_match != SET_GROUP_NUMBER))
-								{
-									/* ADSGPxx */
-									print_char('s');
-									group_array[group_array_index]	= input_val;
-									group_array_index++;
-									if(group_array_index >= 5)
-									{
-										group_array_index = 0;
-									}
-									command_index_match = SET_GROUP_NUMBER;
-									j					= NO_OF_COMMANDS;									// Break out of both the for loops
-									i 					= MAX_CHAR;
-								}
-								else if((j == SET_SCENE_NUMBER) && (command_index_match != SET_SCENE_NUMBER))
-								{
-									/* ADSSNxx */
-									print_char('s');
-									scene_number = input_val;
-									switch(scene_number)
-									{
-									case 1:
-										scene_one 	= percentage_val;
-										break;
-									case 2:
-										scene_two 	= percentage_val;
-										break;
-									case 3:
-										scene_three = percentage_val;
-										break;
-									case 4:
-										scene_four 	= percentage_val;
-										break;
-									case 5:
-										scene_five 	= percentage_val;
-										break;
-									default:
-										break;
-									}
-									scene_number = 0;
-									command_index_match = SET_SCENE_NUMBER;
-									j					= NO_OF_COMMANDS;									// Break out of both the for loops
-									i 					= MAX_CHAR;
-								}
-								else if((j == GET_SCENE_NUMBER) && (command_index_match != GET_SCENE_NUMBER))
-								{
-									/* ADGSNxx */
-									get_scene_number 	= input_val;
-									switch(get_scene_number)
-									{
-									case 1:
-										print_val1(scene_one,2);
-										break;
-									case 2:
-										print_val1(scene_two,2);
-										break;
-									case 3:
-										print_val1(scene_three,2);
-										break;
-									case 4:
-										print_val1(scene_four,2);
-										break;
-									case 5:
-										print_val1(scene_five,2);
-										break;
-									default:
-										break;
-									}
-									command_index_match = GET_SCENE_NUMBER;
-									j 					= NO_OF_COMMANDS;									// Break out of both the for loops
-									i 					= MAX_CHAR;
-								}
-								else if((j == STORE_LIS_GROUP_NUMBER) && (command_index_match != STORE_LIS_GROUP_NUMBER))
-								{
-									/* ADSTGxx */
-									print_char('s');
-									store_group_value   = input_val;
-									command_index_match = STORE_LIS_GROUP_NUMBER;
-									j					= NO_OF_COMMANDS;									// Break out of both the for loops
-									i 					= MAX_CHAR;
-								}
-							}
-							else if((i==6) && (j == GOTO_SCENE_NUMBER) && (command_index_match != GOTO_SCENE_NUMBER))
-							{
-								/* ADGTSNx */
-								print_char('s');
-								go_to_scene		 	= received_val[6] - ASCII_0;
-								switch(go_to_scene)
-								{
-								case 1:
-									percentage_val  = scene_one;
-									set_duty_cycle(percentage_val);
-									break;
-								case 2:
-									percentage_val  = scene_two;
-									set_duty_cycle(percentage_val);
-									break;
-								case 3:
-									percentage_val  = scene_three;
-									set_duty_cycle(percentage_val);
-									break;
-								case 4:
-									percentage_val  = scene_four;
-									set_duty_cycle(percentage_val);
-									break;
-								case 5:
-									percentage_val  = scene_five;
-									set_duty_cycle(percentage_val);
-									break;
-								default:
-									break;
-								}
-								command_index_match = GOTO_SCENE_NUMBER;
-								j					= NO_OF_COMMANDS;									// Break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							else if((i==6) && (j==GET_GROUP_NUMBER) && (command_index_match != GET_GROUP_NUMBER))
-							{
-								/* ADGGPNx */
-								unsigned int group_array_val = received_val[6] - ASCII_1;
-								print_val1(group_array[group_array_val],2);
-   								command_index_match = GET_GROUP_NUMBER;
-								j					= NO_OF_COMMANDS;
-								i 					= MAX_CHAR;
-							}
-							else if((i == 6) && (j == CLEAR_SCENE) && (command_index_match != CLEAR_SCENE))
-							{
-								/* ADCLRSx */
-								print_char('s');
-								scene_number = received_val[6] - ASCII_0;
-								switch(scene_number)
-								{
-								case 1:
-									scene_one = 99;
-									break;
-								case 2:
-									scene_two = 99;
-									break;
-								case 3:
-									scene_three = 99;
-									break;
-								case 4:
-									scene_four = 99;
-									break;
-								case 5:
-									scene_five = 99;
-									break;
-								default:
-									break;
-								}
-								command_index_match = CLEAR_SCENE;
-								j 					= NO_OF_COMMANDS;  											// To break out of both the for loops
-								i 					= MAX_CHAR;
-							}
-							break;														// Break out of the for loops
-						}
-					}
-				}
-				group_match = false;
-			}
-			for (i = 0; i<10 ; i++)
-			{
-				junk = UCA0RXBUF;
-			}
-			IFG2 &= ~UCA0RXIFG;
-			IE2 |= UCA0RXIE;
-		}
-		/* Dim down */
-		if (target_duty > current_duty)
-		{
-			P2OUT |= BIT2;
-			for (i = current_duty; i <= target_duty; i += fade_rate_val)		// Dim down the intensity level
-			{
-				CCR1 	+= fade_rate_val;
-				if(CCR1 >= target_duty + 1)
-				{
-					CCR1 = target_duty;
-					if(isOff == true)
-					{
-						P2OUT &= ~BIT2;
-					}
-					break;
-				}
-				for(j=0; j<delay_value; j++)
-				{
-					__delay_cycles(1);
-				}
+				dispatch_command();
 			}
 		}
-		/* Dim up */
-		else if (target_duty < current_duty)
+		else
 		{
-			P2OUT 	|= BIT2;
-			for (i = current_duty; i >= target_duty; i -= fade_rate_val)
+			frame_length &= ~BINARY_FRAME_FLAG;
+			for(i=NULL; i<frame_length; i++)
 			{
-				CCR1 	-= fade_rate_val;
-				if(CCR1 <= target_duty - 1)
-				{
-					CCR1 = target_duty;
-					break;
-				}
-				for(j=0; j<delay_value; j++)
-				{
-					__delay_cycles(1);
-				}
+				binary_frame[i] = rx_read();
 			}
+			rx_frames_handled++;
+			dispatch_binary_frame(frame_length);
 		}
-		current_duty = target_duty;
 	}
 }
 
-void get_ble_address()
+/* EVENT_MOTION - Reports that the occupancy sensor switched the load back on */
+void handle_motion()
 {
-	ping_flag = YES;														// Set the ping_flag to receive the BLE address
-	IFG2 &= ~UCA0RXIFG;
-	IE2 |= UCA0RXIE;
-	for (i = 0; i<10 ; i++)
-	{
-		junk = UCA0RXBUF;
-	}
-	while (!(IFG2&UCA0TXIFG));                								// USCI_A0 TX buffer ready?
-	UCA0TXBUF = 'p';									                    // TX -> RXed character
-	while (!(IFG2&UCA0TXIFG));                								// USCI_A0 TX buffer ready?
-	UCA0TXBUF = '\r';									                    // TX -> RXed character
-	__bis_SR_register(LPM0_bits + GIE);										// Enter low power mode to receive the response from the ble module
-	character_count = NULL;													// Initialize the count of the number of characters received
-	for(i=3; i>=0; i--)														// Iterate untill all 4 characters are received
+	print_command(true);
+}
+
+/* EVENT_SENSING_TICK - Timer indication of the sensing frequency timeout to detect the motion for analytics */
+void handle_sensing_tick()
+{
+	if((request_mode_flag == YES) && (pir_flag == YES))						// Check whether motion detected
 	{
-		BLE_address[i] = received_val[i];									// Store the received values in a variable array
-		if (BLE_address[i] >= '0' && BLE_address[i] <= '9')					// To convert the ASCII characters to numbers
-		{
-			BLE_address[i] -= ASCII_0;										// Subtract ASCII value of '0' from characters if '0' to '9' are received
-		}
-		else if (BLE_address[i] >= 'A' && BLE_address[i] <= 'F' )
-		{
-			BLE_address[i] -= ASCII_UP_CASE;								// Subtract 55 from characters if 'A' to 'F' are received
-		}
-		else if (BLE_address[i] >= 'a' && BLE_address[i] <= 'f' )
-		{
-			BLE_address[i] -= ASCII_LOW_CASE;								// Subtract 87 from charaters if 'a' to 'f' are received
-		}
+		present_count++;
+		if (present_count >= 255)
+			present_count = NULL;
+		pir_flag = NO;														// Clear PIR flag
 	}
-	ping_flag = NO;															// Reset the ping_flag indicating BLE address are received
-
-	BLE_address_encrypted[0] = (BLE_address[0] << 4) + BLE_address[1];
-	BLE_address_encrypted[1] = (BLE_address[2] << 4) + BLE_address[3];
 }
 
+/* EVENT_OCCUPANCY_TIMEOUT - Timeout indication for occupancy sensor to turn off the load */
+void handle_occupancy_timeout()
+{
+	P2OUT &= ~BIT2;															// switch off all the lights
+	pirOff = 1;
+	P1IFG &= ~BIT5;															// clear interrupt flag to avoid flase trigger because of relay noise
+	TIMER_DISABLE();
+	print_command(false);
+}
 
-void set_duty_cycle(unsigned int Percentage_val)
+/* EVENT_CONFIG_COMMIT - The idle period after the last command is over or the supply sags, write the dirty settings and
+ * the energy meter, or the meter alone when it is due or the supply sags. Without commit_idle the settings wait for
+ * ADWRFLS. */
+void handle_config_commit()
 {
-	percent_normalize 	= 100 - percentage_val;			// To make 0% as min and 100% as max
-														// (Otherwise 0% would be max and 100% would be min)
-	case_value 			= MAX_DUTY * 0.01;						// To convert the value into percentage
-	/* Use the equation y = m*x + c */
-	if(percentage_val >= 0 && percentage_val <= 10)
-	{
-		/* Use c = 3300 */
-		target_duty = (-24 * percentage_val) + 3300;
-	}
-	else if(percentage_val >= 15 && percentage_val <= 66)
-	{
-		/* Use c = 3070 */
-		target_duty = (-24 * (percentage_val - 15)) + 3070;
-	}
-	else if(percentage_val >= 67 && percentage_val < 99)
-	{
-		/* Use c = 1780 */
-		target_duty = (-24 * (percentage_val - 67) + 1780);
-	}
-	else if(percentage_val == 99)
-	{
-		target_duty = 0;
-	}
-	else if(percentage_val == 11)
-	{
-		target_duty = 3085;
-	}
-	else if(percentage_val == 12)
-	{
-		target_duty = 3084;
-	}
-	else if(percentage_val == 13)
-	{
-		target_duty = 3080;
-	}
-	else if(percentage_val == 14)
-	{
-		target_duty = 3075;
-	}
-	if(target_duty >= 3300)								// Manually turn off
-	{
-		isOff = true;
-	}
-	else
+	commit_countdown = NULL;
+	if((config_dirty == YES) && (commit_idle != NULL))
 	{
-		isOff = false;
+		flash_write();
 	}
-	if(sensor_there == true)
+	else if((supply_low == YES) || (meter_minutes >= METER_SAVE_INTERVAL))
 	{
-		TA0CTL 			|= (TASSEL_2 + MC_1 + ID_3);					// Use clock at 1 MHz
-		TA0CCTL0 		|= CCIE;									// Enable Occupancy sensor timer interrupt
-		TA0CCR0 		= PWM_WIDTH;
-		timer_int_count = NULL;
+		meter_save();
 	}
 }
 
-void flash_erase()
+/* Starts or restarts the idle period before handle_config_commit(), commit_idle or else METER_SAVE_IDLE seconds */
+void commit_later()
 {
-	char *Flash_ptr;                          										// Flash pointer - sensing freq
-	unsigned int address_1 = FLASH_ADDRESS_SENSING_FREQ;
-
-	Flash_ptr = (char *) address_1;
-
-	FCTL1 = FWKEY + ERASE;                    										// Set Erase bit
-	FCTL3 = FWKEY;                            										// Clear Lock bit
-	*Flash_ptr = 0;                           										// Dummy write to erase Flash segment
-
-	FCTL1 = FWKEY + WRT;                      										// Set WRT bit for write operation
-
-	FCTL1 = FWKEY;                            										// Clear WRT bit
-	FCTL3 = FWKEY + LOCK;                     										// Set LOCK bits
+	commit_countdown = CHECKPOINTS((commit_idle != NULL) ? commit_idle : METER_SAVE_IDLE) + 1;
 }
 
 /*********************************************************************************************************************************
- * Function name			: flash_write()
- * Date         			: 21/6/2017
+ * Function name			: handle_minute()
+ * Date         			: 17/10/2026
  * Passing parameters 		: None
  * Returning parameters 	: None
  * Author 					: Suhas K V
- * Description 				: This function writes all critical values like sensing freqency, occupancy sensor time out, host address,
- * 							  commissioning flag status into flash memory. This does not take any parameter nor return any.
- *********************************************************************************************************************************/
-void flash_write()
+ * Description 				: EVENT_MINUTE - Takes the counts of the minute that is over. The relay on time and the light output are
+ * 							  scaled from checkpoints to seconds and added to the energy meter. Every METER_SAVE_INTERVAL minutes
+ * 							  the meter is due and written by handle_config_commit() once no command has come for the idle period.
+ * 							  The minute is added to the running occupancy interval, which is packed into the occupancy history
+ * 							  once OCCUPANCY_INTERVAL minutes are over.
+ **********************************************************************************************************************************/
+void handle_minute()
 {
-	char *Flash_ptr_1;                          									// Flash pointer - sensing freq
-	char *Flash_ptr_2;																// Flash pointer - occupancy sensor time-out
-	char *Flash_ptr_3;																// Flash pointer - host address
-	char *Flash_ptr_6;																// Flash pointer - commissioning flag
-	char *Flash_ptr_7;																// Flash pointer - fade rate value
-	char *Flash_ptr_8;																// Flash pointer - fade delay value
-	char *Flash_ptr_9;																// Flash pointer - power on value
-	char *Flash_ptr_10;																// Flash pointer - group one
-	char *Flash_ptr_11;																// Flash pointer - group two
-	char *Flash_ptr_12;																// Flash pointer - group three
-	char *Flash_ptr_13;																// Flash pointer - group four
-	char *Flash_ptr_14;																// Flash pointer - group five
-	char *Flash_ptr_15;																// Flash pointer - scene number one
-	char *Flash_ptr_16;																// Flash pointer - scene number two
-	char *Flash_ptr_17;																// Flash pointer - scene number three
-	char *Flash_ptr_18;																// Flash pointer - scene number four
-	char *Flash_ptr_19;																// Flash pointer - scene number five
-	char *Flash_ptr_20;																// Flash pointer - LIS mode
-	char *Flash_ptr_21;																// Flash pointer - LIS group number
-	char *Flash_ptr_22;																// Flash pointer - polling host address
-
-	unsigned int address_1 = FLASH_ADDRESS_SENSING_FREQ;
-	unsigned int address_2 = FLASH_ADDRESS_TIME_OUT;
-	unsigned int address_3 = FLASH_HOST_ADDRESS;
-	unsigned int address_6 = FLASH_ADDRESS_COM_FLAG;
-	unsigned int address_7 = FLASH_FADE_RATE_VALUE;
-	unsigned int address_8 = FLASH_FADE_DELAY_VALUE;
-	unsigned int address_9 = FLASH_PERCENTAGE_VALUE;
-	unsigned int address_10= FLASH_GROUP_ONE;
-	unsigned int address_11= FLASH_GROUP_TWO;
-	unsigned int address_12= FLASH_GROUP_THREE;
-	unsigned int address_13= FLASH_GROUP_FOUR;
-	unsigned int address_14= FLASH_GROUP_FIVE;
-	unsigned int address_15= FLASH_SCENE_ONE;
-	unsigned int address_16= FLASH_SCENE_TWO;
-	unsigned int address_17= FLASH_SCENE_THREE;
-	unsigned int address_18= FLASH_SCENE_FOUR;
-	unsigned int address_19= FLASH_SCENE_FIVE;
-	unsigned int address_20= FLASH_LIS_MODE;
-	unsigned int address_21= FLASH_LIS_GROUP_NUMBER;
-	unsigned int address_22= FLASH_POLLING_HOST_ADDRESS;
-
-	Flash_ptr_1 = (char *) address_1;              									// Initialize Flash pointer
-	Flash_ptr_2 = (char *) address_2;
-	Flash_ptr_3 = (char *) address_3;
-	Flash_ptr_6 = (char *) address_6;
-	Flash_ptr_7 = (char *) address_7;
-	Flash_ptr_8 = (char *) address_8;
-	Flash_ptr_9 = (char *) address_9;
-	Flash_ptr_10= (char *) address_10;
-	Flash_ptr_11= (char *) address_11;
-	Flash_ptr_12= (char *) address_12;
-	Flash_ptr_13= (char *) address_13;
-	Flash_ptr_14= (char *) address_14;
-	Flash_ptr_15= (char *) address_15;
-	Flash_ptr_16= (char *) address_16;
-	Flash_ptr_17= (char *) address_17;
-	Flash_ptr_18= (char *) address_18;
-	Flash_ptr_19= (char *) address_19;
-	Flash_ptr_20= (char *) address_20;
-	Flash_ptr_21= (char *) address_21;
-	Flash_ptr_22= (char *) address_22;
-
-	FCTL1 = FWKEY + ERASE;                    										// Set Erase bit
-	FCTL3 = FWKEY;                            										// Clear Lock bit
-	*Flash_ptr_1 = 0;                           									// Dummy write to erase Flash segment
-
-	FCTL1 = FWKEY + WRT;                      										// Set WRT bit for write operation
-
-	*Flash_ptr_1 = sensing_freq;                   									// Write value to flash
-	*Flash_ptr_2 = time_out;
-	*Flash_ptr_6 = commissioning_flag;
-	*Flash_ptr_7 = fade_rate_val;
-	*Flash_ptr_9 = power_on_value;
-	*Flash_ptr_10= group_array[0];
-	*Flash_ptr_11= group_array[1];
-	*Flash_ptr_12= group_array[2];
-	*Flash_ptr_13= group_array[3];
-	*Flash_ptr_14= group_array[4];
-
-	for(i=NULL; i<4; i++)
+	unsigned char checkpoints;
+	unsigned char occupied;
+	unsigned char relay_on;
+	unsigned char relay_starts;
+	unsigned int light;
+	unsigned char motions;
+
+	__disable_interrupt();
+	checkpoints 		= minute_checkpoints;
+	occupied 			= minute_occupied;
+	relay_on 			= minute_relay_on;
+	relay_starts 		= minute_relay_starts;
+	light 				= minute_light;
+	minute_checkpoints 	= NULL;
+	minute_occupied 	= NULL;
+	minute_relay_on 	= NULL;
+	minute_relay_starts = NULL;
+	minute_light 		= NULL;
+	__enable_interrupt();
+	if(checkpoints == NULL)
 	{
-		*Flash_ptr_3++ = HOST_address[i];                   						// Write value to flash
+		return;																// No checkpoint counted, nothing to scale
 	}
 
-	for(i=NULL; i<4; i++)
+	meter_counts[METER_ENERGY] 			+= (((unsigned long)light * 60) + ((checkpoints * METER_LIGHT_FULL) / 2)) / (checkpoints * METER_LIGHT_FULL);
+	meter_counts[METER_ON_TIME] 		+= ((relay_on * 60) + (checkpoints / 2)) / checkpoints;
+	meter_counts[METER_RELAY_CYCLES] 	+= relay_starts;
+	if(meter_minutes < METER_SAVE_INTERVAL)
 	{
-		*Flash_ptr_22++ = POLLING_HOST_address[i];                   						// Write value to flash
+		meter_minutes++;
 	}
-
-	for(i=NULL; i<2; i++)
+	if((meter_minutes >= METER_SAVE_INTERVAL) && (commit_countdown == NULL))
 	{
-		*Flash_ptr_8++ = temp_delay[i];                   							// Write value to flash
+		commit_later();														// Written once the UART has been quiet
 	}
 
-	*Flash_ptr_15 = scene_one;
-	*Flash_ptr_16 = scene_two;
-	*Flash_ptr_17 = scene_three;
-	*Flash_ptr_18 = scene_four;
-	*Flash_ptr_19 = scene_five;
-	*Flash_ptr_20 = lis_mode;
-	*Flash_ptr_21 = store_group_value;
-
-	FCTL1 = FWKEY;                            										// Clear WRT bit
-	FCTL3 = FWKEY + LOCK;                     										// Set LOCK bits
+	if((occupied * 2) >= checkpoints)
+	{
+		occupancy_occupied++;
+	}
+	if(++occupancy_minutes < OCCUPANCY_INTERVAL)
+	{
+		return;
+	}
+	__disable_interrupt();
+	motions 			= occupancy_motions;
+	occupancy_motions 	= NULL;
+	__enable_interrupt();
+	occupied = ((occupancy_occupied * OCCUPANCY_FRACTION_STEPS) + (OCCUPANCY_INTERVAL / 2)) / OCCUPANCY_INTERVAL;
+	occupancy_history[occupancy_head] = OCCUPANCY_SAMPLE_FLAG | (occupied << OCCUPANCY_FRACTION_SHIFT) | motions;
+	occupancy_head = (occupancy_head + 1) % OCCUPANCY_SAMPLES;
+	if(occupancy_samples < OCCUPANCY_SAMPLES)
+	{
+		occupancy_samples++;
+	}
+	occupancy_minutes 	= NULL;
+	occupancy_occupied 	= NULL;
 }
 
-/*********************************************************************************************************************************
- * Function name			: flash_read(unsigned int address)
- * Date         			: 21/6/2017
- * Passing parameters 		: unsigned int address
- * Returning parameters 	: return_val
- * Author 					: Suhas K V
- * Description 				: This function reads all critical values like sensing freqency, occupancy sensor time out, host address,
- * 							  commissioning flag status into flash memory. This does not take any parameter nor return any.
- *********************************************************************************************************************************/
-unsigned char flash_read(unsigned int address)
+/* EVENT_DIMMING - Dim up or down, a new target_duty restarts a running fade from the present level */
+void handle_dimming()
 {
-	char *Flash_ptr;                          										// Flash pointer
-	unsigned char return_val;
-	Flash_ptr = (char *) address;              										// Initialize Flash pointer
-	return_val = *Flash_ptr;
-	return return_val;
+	if((identify_phases == NULL) && ((target_duty != fade_target) || ((fade_active == NO) && (CCR1 != target_duty))))
+	{
+		start_fade();
+	}
 }
 
-
 /*********************************************************************************************************************************
- * Function name			: print_val1(unsigned int Value, unsigned int polling_host)
- * Date         			: 21/6/2017
- * Passing parameters 		: unsigned int Value
- * Returning parameters 	: None
- * Author 					: Subrahmanya K S and Suhas K V
- * Description 				: This function will accept the value to be sent out through BLE and sends it to the destination address.
+ * Function name			: find_command()
+ * Date         			: 17/10/2026
+ * Passing parameters 		: None
+ * Returning parameters 	: Command index of the frame in received_val, NO_COMMAND if it is not a valid command
+ * Author 					: Suhas K V
+ * Description 				: The opcode hash is built one character at a time. After every character the slot table is probed and
+ * 							  the candidate is accepted only if its opcode length matches and its opcode matches msg_arr.
  **********************************************************************************************************************************/
-void print_val1(unsigned int Value, unsigned int polling_host)
+unsigned char find_command()
 {
-	for(i=0; i<2; i++)
-	{
-		while (!(IFG2&UCA0TXIFG));                									// USCI_A0 TX buffer ready?
-		UCA0TXBUF = send_msg[i];                    								// TX -> RXed character
-	}
+	unsigned int hash = COMMAND_HASH_SEED;
+	unsigned char length;
+	unsigned char index;
+	unsigned char command;
 
-	if(polling_host==1)
+	if((received_val[0] != 'A') || (received_val[1] != 'D'))
 	{
-		for(i=NULL; i<4; i++)
-		{
-			while (!(IFG2&UCA0TXIFG));                									// USCI_A0 TX buffer ready?
-			UCA0TXBUF = POLLING_HOST_address[i];                    							// TX -> RXed character
-		}
+		return NO_COMMAND;
 	}
-	else if(polling_host==2)
+
+	for(length = MIN_OPCODE_LENGTH; length <= (LAST_CHAR + 1); length++)
 	{
-		for(i=NULL; i<4; i++)
+		hash 	= COMMAND_HASH_STEP(hash, received_val[length - 1]);
+		command = command_slot[COMMAND_SLOT(hash)];
+		if((command != NO_COMMAND) && (command_length[command] == length))
 		{
-			while (!(IFG2&UCA0TXIFG));                									// USCI_A0 TX buffer ready?
-			UCA0TXBUF = HOST_address[i];                    							// TX -> RXed character
+			for(index = 2; index < length; index++)
+			{
+				if(received_val[index] != msg_arr[command][index])
+				{
+					break;
+				}
+			}
+			if(index == length)
+			{
+				return command;
+			}
 		}
 	}
+	return NO_COMMAND;
+}
 
-	while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-	UCA0TXBUF = ' ';                    											// TX -> RXed character
+/*********************************************************************************************************************************
+ * Function name			: dispatch_command()
+ * Date         			: 17/10/2026
+ * Passing parameters 		: None
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Looks up the received command and runs its handler. A command repeated back to back is ignored until
+ * 							  the UART timeout clears command_index_match.
+ **********************************************************************************************************************************/
+void dispatch_command()
+{
+	unsigned char command = find_command();
 
-	for(i=NULL; i<2; i++)
+	if(command != NO_COMMAND)
 	{
-		if(BLE_address_encrypted[i] == 10)
+		if((command == SET_SCENE_NUMBER) || (command == GET_SCENE_NUMBER))			// Scenes 00 to 0F, hex as in ADGTSNx
 		{
-			while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-			UCA0TXBUF = 254;                    											// TX -> RXed character
-			char_change_flag |= (0x80 - (i * 0x40));
+			input_val 	= (hex_to_nibble(received_val[MSB]) << 4) + hex_to_nibble(received_val[LSB]);
 		}
-		else if(BLE_address_encrypted[i] == 13)
+		else if(command_length[command] == 5)
 		{
-			while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-			UCA0TXBUF = 255;                    											// TX -> RXed character
-			char_change_flag |= (0x80 - (i * 0x40));
+			msb 		= received_val[MSB] - ASCII_0;								// retreive MSB from the command
+			lsb 		= received_val[LSB] - ASCII_0;								// retreive LSB from the command
+			input_val 	= (msb * TEN) + lsb;										// get the actual number
 		}
-		else
+		else if(command_length[command] == 6)
 		{
-			while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-			UCA0TXBUF = BLE_address_encrypted[i];                    											// TX -> RXed character
+			input_val 	= hex_to_nibble(received_val[LAST_CHAR]);					// Scenes 0 to F
 		}
+		execute_command(command);
 	}
+}
 
-	if(Value == 10)
-	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 254;                    											// TX -> RXed character
-		char_change_flag |= 0x20;
-	}
-	else if(Value == 13)
-	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 255;                    											// TX -> RXed character
-		char_change_flag |= 0x20;
-	}
-	else
-	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = Value;                    											// TX -> RXed character
-	}
+/*********************************************************************************************************************************
+ * Function name			: dispatch_binary_frame(unsigned char length)
+ * Date         			: 17/10/2026
+ * Passing parameters 		: unsigned char length - number of encoded bytes in binary_frame
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Decodes a binary request in place, checks its CRC and runs the command. The opcode is the command
+ * 							  index, so the handler and the expected parameter length are a single table lookup. The parameters
+ * 							  are left where the ASCII handlers expect them: the value in input_val, address characters and the
+ * 							  group address in received_val.
+ **********************************************************************************************************************************/
+void dispatch_binary_frame(unsigned char length)
+{
+	unsigned char command;
+	unsigned char index;
+	unsigned int crc;
 
-	checksum = BLE_address_encrypted[0] + BLE_address_encrypted[1] + Value;
-	if(checksum == 10)
+	length = cobs_decode(binary_frame, length, COBS_REQUEST_DELIMITER);
+	if(length < BINARY_REQUEST_OVERHEAD)
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 254;                    											// TX -> RXed character
-		char_change_flag |= 0x10;
+		return;
 	}
-	else if(checksum == 13)
+	length -= CRC_LENGTH;
+	crc = crc16(binary_frame, length);
+	if((binary_frame[length] != (unsigned char)(crc >> 8)) || (binary_frame[length + 1] != (unsigned char)crc))
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 255;                    											// TX -> RXed character
-		char_change_flag |= 0x10;
+		rx_crc_errors++;
+		return;
 	}
-	else
+
+	if((length != binary_frame[2] + BINARY_REQUEST_OVERHEAD - CRC_LENGTH) || (group_address_match(binary_frame[1]) == false))
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = checksum;                    											// TX -> RXed character
+		return;
 	}
+	timer_count 	= NULL;
+	received_val[7] = binary_frame[1];
 
-	checksum = checksum >> 8;
-	if(checksum == 10)
+	command = binary_frame[0];
+	if(command == BINARY_BATCH_OPCODE)
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 254;                    											// TX -> RXed character
-		char_change_flag |= 0x08;
+		execute_batch(crc);
+		return;
 	}
-	else if(checksum == 13)
+	if((command >= NO_OF_COMMANDS) || (binary_frame[2] != command_parameter_length[command]))
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 255;                    											// TX -> RXed character
-		char_change_flag |= 0x08;
+		return;
 	}
-	else
+	input_val 		= binary_frame[3];
+	for(index=NULL; index<binary_frame[2]; index++)
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = checksum;                    											// TX -> RXed character
+		received_val[index + 3] = binary_frame[index + 3];
 	}
-
-	while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-	UCA0TXBUF = char_change_flag;                    											// TX -> RXed character
-
-	while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-	UCA0TXBUF = '\n';
-	while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-	UCA0TXBUF = '\r';
-	__delay_cycles(1);
-	Value = NULL;
-	char_change_flag = UNITY;
+	execute_command(command);
 }
 
 /*********************************************************************************************************************************
- * Function name			: print_val1(unsigned int Value)
- * Date         			: 21/6/2017
- * Passing parameters 		: None
+ * Function name			: execute_batch(unsigned int crc)
+ * Date         			: 17/10/2026
+ * Passing parameters 		: unsigned int crc - CRC of the batch request in binary_frame
  * Returning parameters 	: None
- * Author 					: Subrahmanya K S and Suhas K V
- * Description 				: This function will send the sensing frequency and occupnacy sensor time out out through BLE and sends
- * 							  it to the destination address.
+ * Author 					: Suhas K V
+ * Description 				: Checks every command of the batch and its value first and runs them only if all of them are valid, so
+ * 							  a node is never left with half a configuration. The commands run with their responses suppressed and
+ * 							  the batch is answered once with the number of commands run, the bitmap of the commands run and the
+ * 							  position of the command that rejected it. A repeated batch is ignored until the UART timeout, like a
+ * 							  repeated command.
  **********************************************************************************************************************************/
-void print_setting()
+void execute_batch(unsigned int crc)
 {
-	for(i=0; i<2; i++)
+	unsigned char response[BATCH_RESPONSE_LENGTH];
+	unsigned char end = binary_frame[2] + 3;
+	unsigned char index = 3;
+	unsigned char count = NULL;
+	unsigned char ran = NULL;
+	unsigned char command;
+	unsigned char parameter;
+	unsigned int status = NULL;
+
+	if((command_index_match == BINARY_BATCH_OPCODE) && (crc == batch_crc))
 	{
-		while (!(IFG2&UCA0TXIFG));                									// USCI_A0 TX buffer ready?
-		UCA0TXBUF = send_msg[i];                    								// TX -> RXed character
+		return;
 	}
 
-	for(i=NULL; i<4; i++)
+	while((index < end) && (count < BATCH_MAX_OPS))
 	{
-		while (!(IFG2&UCA0TXIFG));                									// USCI_A0 TX buffer ready?
-		UCA0TXBUF = HOST_address[i];                    							// TX -> RXed character
+		command = binary_frame[index];
+		if((command >= NO_OF_COMMANDS) || (command_batch[command] == NO)
+									   || (command_parameter_length[command] >= end - index)
+									   || (command_refuses(command, binary_frame[index + 1]) == YES))
+		{
+			break;
+		}
+		count++;
+		index += command_parameter_length[command] + 1;
 	}
 
-	while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-	UCA0TXBUF = ' ';                    											// TX -> RXed character
-
-	for(i=NULL; i<2; i++)
+	if(index == end)
 	{
-		if(BLE_address_encrypted[i] == 10)
-		{
-			while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-			UCA0TXBUF = 254;                    											// TX -> RXed character
-			char_change_flag |= (0x80 - (i * 0x40));
-		}
-		else if(BLE_address_encrypted[i] == 13)
+		response_muted = YES;
+		for(index=3; index<end; index+=command_parameter_length[command]+1)
 		{
-			while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-			UCA0TXBUF = 255;                    											// TX -> RXed character
-			char_change_flag |= (0x80 - (i * 0x40));
-		}
-		else
-		{
-			while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-			UCA0TXBUF = BLE_address_encrypted[i];                    											// TX -> RXed character
+			command 		= binary_frame[index];
+			input_val 		= binary_frame[index + 1];
+			for(parameter=NULL; parameter<command_parameter_length[command]; parameter++)
+			{
+				received_val[parameter + 3] = binary_frame[index + parameter + 1];
+			}
+			run_command(command);
+			status |= 1U << ran;
+			ran++;
 		}
+		response_muted = NO;
+		count = BATCH_ACCEPTED;
 	}
 
-	time_out = max_timer_count / _1_MIN;											// Calculate the time out value
+	command_index_match = BINARY_BATCH_OPCODE;
+	batch_crc 			= crc;
+	current_command 	= BINARY_BATCH_OPCODE;
+	response[0] 		= ran;
+	response[1] 		= status;
+	response[2] 		= status >> 8;
+	response[3] 		= count;
+	send_frame(FRAME_HOST, response, BATCH_RESPONSE_LENGTH, BATCH_RESPONSE_LENGTH);
+}
 
-	if(time_out == 10)
-	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 254;                    											// TX -> RXed character
-		char_change_flag |= 0x20;
-	}
-	else if(time_out == 13)
+/* Returns YES for a value a command answers with 'e' instead of taking it, so that a batch is checked before it runs */
+unsigned char command_refuses(unsigned char command, unsigned char value)
+{
+	switch(command)
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 255;                    											// TX -> RXed character
-		char_change_flag |= 0x20;
+	case SET_PIR_WINDOW:
+	case SET_PIR_CONFIRM:
+		return (value == NULL) ? YES : NO;
+	case SET_SCENE_NUMBER:
+	case GET_SCENE_NUMBER:
+	case GOTO_SCENE_NUMBER:
+	case CLEAR_SCENE:
+		return (value >= SCENES) ? YES : NO;
+	default:
+		return NO;
 	}
-	else
+}
+
+/* Runs a command unless it repeats the previous one before the UART timeout cleared command_index_match */
+void execute_command(unsigned char command)
+{
+	if(command != command_index_match)
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = time_out;                    											// TX -> RXed character
+		run_command(command);
+		command_index_match = command;
 	}
+}
 
-	if(power_on_value == 10)
+/* Runs the handler of a command. A command that leaves a setting different from the flash marks the settings dirty and
+ * starts the idle period before the automatic flash write, whether it came alone or in a batch. Any other command
+ * restarts an idle period already running, so the flash is not written while the host is busy with the node. */
+void run_command(unsigned char command)
+{
+	current_command = command;
+	command_handler[command]();
+	if((command_batch[command] == YES) && (config_changed() == YES))			// The commands allowed in a batch are the setting ones
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 254;                    											// TX -> RXed character
-		char_change_flag |= 0x10;
+		config_dirty = YES;
+		if(commit_idle != NULL)
+		{
+			commit_later();
+		}
 	}
-	else if(power_on_value == 13)
+	else if(commit_countdown != NULL)
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 255;                    											// TX -> RXed character
-		char_change_flag |= 0x10;
+		commit_later();
 	}
-	else
+}
+
+/* Returns true if the frame is a broadcast or is addressed to one of the groups of this node */
+unsigned char group_address_match(unsigned char address)
+{
+	if(address == BROADCAST_ADDRESS)
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = power_on_value;                    											// TX -> RXed character
+		return true;
 	}
+	return (group_member(address) == YES) ? true : false;
+}
 
-	while (!(IFG2&UCA0TXIFG));                											// USCI_A0 TX buffer ready?
-	UCA0TXBUF = fade_rate_val;                    										// TX -> RXed character
+/* Takes the next byte out of the UART receive queue */
+unsigned char rx_read()
+{
+	unsigned char character = rx_buffer[rx_tail];
 
-	for(i=NULL; i<2; i++)
-	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = temp_delay[i];                    									// TX -> RXed character
-	}
+	rx_tail = (rx_tail + 1) & (RX_BUFFER_SIZE - 1);
+	return character;
+}
 
-	checksum = BLE_address_encrypted[0] +
-					BLE_address_encrypted[1] +
-						time_out + power_on_value + fade_rate_val +
-							temp_delay[0] + temp_delay[1];
-	if(checksum == 10)
+unsigned char hex_to_nibble(unsigned char character)
+{
+	if (character >= '0' && character <= '9')
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 254;                    											// TX -> RXed character
-		char_change_flag |= 0x08;
+		character -= ASCII_0;												// Subtract ASCII value of '0' from characters if '0' to '9' are received
 	}
-	else if(checksum == 13)
+	else if (character >= 'A' && character <= 'F' )
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 255;                    											// TX -> RXed character
-		char_change_flag |= 0x08;
+		character -= ASCII_UP_CASE;											// Subtract 55 from characters if 'A' to 'F' are received
 	}
-	else
+	else if (character >= 'a' && character <= 'f' )
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = checksum;                    											// TX -> RXed character
+		character -= ASCII_LOW_CASE;										// Subtract 87 from charaters if 'a' to 'f' are received
 	}
+	return character;
+}
 
-	checksum = checksum >> 8;
-	if(checksum == 10)
+/* Copy the 4 address characters of an ADH/ADR/ADP frame and pack them into 2 bytes */
+void parse_address(unsigned char *address, unsigned int *address_encrypted)
+{
+	for(i=NULL; i<4; i++)
+	{
+		address[i] = received_val[i + 3];
+	}
+	address_encrypted[0] = (hex_to_nibble(address[0]) << 4) + hex_to_nibble(address[1]);
+	address_encrypted[1] = (hex_to_nibble(address[2]) << 4) + hex_to_nibble(address[3]);
+	update_frame_header();
+}
+
+/* ADHxxxx - Change host address if sensor is not commissioned */
+void command_set_host_address()
+{
+	if(commissioning_flag == 0)
+	{
+		parse_address(HOST_address, HOST_address_encrypted);
+		print_address(2);
+	}
+}
+
+/* ADRxxxx */
+void command_reset_host_address()
+{
+	parse_address(HOST_address, HOST_address_encrypted);
+	print_address(2);
+}
+
+/* ADPxxxx */
+void command_polling_host_address()
+{
+	parse_address(POLLING_HOST_address, POLLING_HOST_address_encrypted);
+	print_address(1);
+}
+
+/* ADSSFxx */
+void command_set_sensing_freq()
+{
+	print_char('s');
+	sensing_freq 		= input_val;								// Store the number in sensing_freq variable
+	sensing_freq_val 	= CHECKPOINTS(sensing_freq);				// Convert the number into sensing frequency value count
+	timer_count_1 		= NULL;										// Clear the sensing frequency timer count
+	pending_events 		&= ~EVENT_SENSING_TICK;						// Drop a sensing frequency tick not handled yet
+}
+
+/* ADSTOxx */
+void command_set_timeout()
+{
+	print_char('s');
+	time_out 			= input_val;								// Store the number in time_out variable
+	timer_int_count 	= NULL;
+	max_timer_count 	= time_out * _1_MIN;						// Convert the number into count value
+}
+
+/* ADOPLxx Power On Level*/
+void command_set_power_on_level()
+{
+	print_char('s');
+	power_on_value 		= input_val;
+}
+
+/* ADSPLxx */
+void command_set_percentage_level()
+{
+	print_char('s');
+	percentage_val 		= input_val;
+	set_duty_cycle(percentage_val);
+}
+
+/* ADFDRxx */
+void command_set_fade_rate_value()
+{
+	print_char('s');
+	fade_rate_val 		= input_val;
+}
+
+/* ADFDDxx */
+void command_set_fade_delay_value()
+{
+	print_char('s');
+	temp_delay[0] 		= input_val / TEN;
+	temp_delay[1] 		= input_val % TEN;
+	delay_value 		= ((temp_delay[0] * 10) + (temp_delay[1] * 1)) * 10;
+}
+
+/* ADSGPxx */
+void command_set_group_number()
+{
+	print_char('s');
+	group_write(input_val, YES);
+}
+
+/* ADSSNxx - Scene 00 to 0F */
+void command_set_scene_number()
+{
+	scene_command(SCENE_STORE);
+}
+
+/* ADGSNxx - Scene 00 to 0F */
+void command_get_scene_number()
+{
+	scene_command(SCENE_GET);
+}
+
+/* ADSTGxx */
+void command_store_lis_group_number()
+{
+	print_char('s');
+	store_group_value   = input_val;
+}
+
+/* ADGTSNx - Scene 0 to F */
+void command_goto_scene_number()
+{
+	scene_command(SCENE_RECALL);
+}
+
+/* ADGGPNx, the xth group of the node from the lowest, GROUP_NONE past the last */
+void command_get_group_number()
+{
+	unsigned char group = NULL;
+	unsigned char count = NULL;
+
+	for(group = NULL; group < BROADCAST_ADDRESS; group++)
+	{
+		if((group_member(group) == YES) && (++count == input_val))
+		{
+			break;
+		}
+	}
+	print_val1(((input_val != NULL) && (count == input_val)) ? group : GROUP_NONE, 2);
+}
+
+/* ADCLRSx - Scene 0 to F */
+void command_clear_scene()
+{
+	scene_command(SCENE_CLEAR);
+}
+
+/* ADIDDEV */
+void command_identify_device()
+{
+	print_char('s');															// Send acknowledgement
+	start_identify();															// Blink the load from Timer_A
+}
+
+/* ADWRFLS */
+void command_flash_write()
+{
+	print_char('s');															// Send acknowledgement
+	flash_write();																// Write to flash memory
+}
+
+/* ADCMSET */
+void command_set_commissioning_flag()
+{
+	print_char('s');															// Send acknowledgement
+	commissioning_flag = YES;													// Set the commissioning flag
+}
+
+/* ADCMRST */
+void command_reset_commissioning_flag()
+{
+	print_char('s');															// Send acknowledgement
+	commissioning_flag = NO;													// Reset the commissioning flag
+}
+
+/* ADGSD00 */
+void command_get_sensor_data()
+{
+	print_val1(present_count+1,2);												// Send the count of movement
+}
+
+/* ADCLROS */
+void command_clear_count()
+{
+	print_char('s');															// Send acknowledgement
+	present_count 		= NULL;													// Clear the count value
+}
+
+/* ADLADON */
+void command_relay_on()
+{
+	print_char('s');															// Send acknowledgement
+	P2OUT 				|= BIT2;												// Switch on all lights
+	P1IE 				&= ~BIT5;												// Disable PIR sensor interrupt
+	timer_int_count 	= NULL;													// Clear occupancy sensor timer count
+	timer_count_1 		= NULL;													// Clear sensing frequecy timer count
+	isOff 				= false;
+	set_duty_now(NULL);
+	sensor_there		= false;
+	TIMER_DISABLE();															// Disable occupancy sensor timer
+	REQUEST_MODE_TIMER_DISABLE();												// Disable request mode timer
+}
+
+/* ADLADOF */
+void command_relay_off()
+{
+	print_char('s');															// Send acknowledgement
+	P2OUT 				&= ~BIT2;												// switch off all lights
+	P1IE 				&= ~BIT5;												// Disable PIR sensor interrupt
+	timer_int_count 	= NULL;													// Clear occupancy sensor timer count
+	timer_count_1 		= NULL;													// Clear sensing frequecy timer count
+	isOff 				= true;
+	set_duty_now(DUTY_OFF);
+	sensor_there 		= false;
+	TIMER_DISABLE();															// Disable occupancy sensor timer
+	REQUEST_MODE_TIMER_DISABLE();												// Disable request mode timer
+}
+
+/* ADDISOS */
+void command_disable_os()
+{
+	print_char('s');															// Send acknowledgement
+	P1IE 				&= ~BIT5;												// Disable the PIR sensor interrupt
+	sensor_there 		= false;
+	lis_mode			= OFF;
+	TIMER_DISABLE();															// Disable occupancy sensor timer
+	REQUEST_MODE_TIMER_DISABLE();												// Disable request mode timer
+}
+
+/* ADENAOS */
+void command_enable_os()
+{
+	print_char('s');															// Send acknowledgement
+	PIR_INIT();
+	sensor_there		= true;
+	lis_mode			= ON;
+	TIMER_INIT();																// Enable occupancy sensor timer
+	REQUEST_MODE_TIMER_INIT();													// Enable request mode timer
+}
+
+/* ADGSF00 */
+void command_get_sensing_freq()
+{
+	print_val1(sensing_freq,2);													// Send the sensing frequency value
+}
+
+/* ADFTRST */
+void command_factory_reset()
+{
+	print_char('s');															// Send acknowledgement
+	P1IE 				&= ~BIT5;												// Disable the PIR sensor interrupt
+	sensor_there 		= false;
+	lis_mode			= false;
+	pir_flag 			= NO;													// Clear the PIR flag
+	present_count 		= NULL;													// Clear the present count
+	sensing_freq 		= 15;
+	sensing_freq_val 	= CHECKPOINTS(15);										// Set the sensing frequency to 15s
+	timer_int_count 	= NULL;													// Clear occupancy sensor timer count
+	timer_count_1 		= NULL;													// Clear sensing frequecy timer count
+	max_timer_count 	= _15_MIN;												// Set max_timer_count value to 15 mins
+	time_out 			= max_timer_count / _1_MIN;								// Calculate the occupancy sensor time out value
+	P2OUT 			   	|= BIT2;												// Switch ON the load
+	set_duty_now(NULL);
+	isOff 				= false;
+	pirOff 				= true;
+	power_on_value 		= 99;
+	delay_value 		= 300;
+	temp_delay[0] 		= 3;
+	temp_delay[1] 		= 0;
+	fade_rate_val 		= 1;
+	fade_time 			= NULL;
+	commissioning_flag 	= RESET;
+	commit_idle 		= NULL;
+	commit_countdown 	= NULL;
+	TIMER_INIT();																// Enable occupancy sensor timer & set pwm output mode
+	TIMER_DISABLE();															// Disable occupancy sensor timer
+	REQUEST_MODE_TIMER_DISABLE();												// Disable request mode timer
+	flash_erase();																// Write into flash memory
+	config_dirty 		= NO;
+}
+
+/* ADGSSET */
+void command_get_sensor_settings()
+{
+	print_setting();															// Send sensing frequency and time out value
+}
+
+/* ADERQOS */
+void command_enable_req_mode()
+{
+	print_char('s');															// Send acknowledgement
+	request_mode_flag 	= YES;
+	PIR_INIT();
+	pir_flag 			= NO;													// Clear pir_flag
+	P2OUT 				|= BIT2;												// Switch ON load
+	target_duty 		= NULL;
+	isOff 				= false;
+	power_on_value 		= 99;
+	delay_value 		= 300;
+	temp_delay[0] 		= 3;
+	temp_delay[1] 		= 0;
+	fade_rate_val 		= 1;
+	fade_time 			= NULL;
+	sensor_there 		= true;
+	lis_mode			= ON;
+
+	TIMER_INIT();																// Start 15s and occupancy sensor timer
+	REQUEST_MODE_TIMER_INIT();													// Start 15s request mode timer
+}
+
+/* ADGTOOS */
+void command_get_timeout_val()
+{
+	time_out 			= max_timer_count / _1_MIN;								// Calculate the time out value
+	print_val1(time_out,2);														// Send time out value
+}
+
+/* ADGPLAD */
+void command_get_percentage_level()
+{
+	print_val1(percentage_val,2);												// Send acknowledgement
+}
+
+/* ADGNOGP */
+void command_get_no_of_groups()
+{
+	unsigned char no_of_groups = NULL;
+	unsigned char group;
+
+	for(group = NULL; group < BROADCAST_ADDRESS; group++)
+	{
+		if(group_member(group) == YES)
+		{
+			no_of_groups++;
+		}
+	}
+	print_val1(no_of_groups,2);
+}
+
+/* ADCLRGP */
+void command_clear_group()
+{
+	print_char('s');
+	group_write(received_val[7], NO);
+}
+
+/* ADGGPLS */
+void command_get_lis_group()
+{
+	print_val1(store_group_value,2);
+}
+
+/* ADCRGPL */
+void command_clear_lis_group()
+{
+	print_char('s');
+	store_group_value 	= 0xff;
+}
+
+/* ADGSTAT */
+void command_get_health_status()
+{
+	print_val1(percentage_val,1);												// Send acknowledgement
+}
+
+/* ADDROAD - Answered by handle_ble_address() once the BLE module has replied or the request is given up */
+void command_receive_own_address()
+{
+	ble_address_reply = YES;
+	ble_address_tries = BLE_ADDRESS_TRIES;
+	get_ble_address();
+}
+
+/* ADGTXHW */
+void command_get_tx_high_water()
+{
+	print_val1(tx_high_water,2);												// Send the deepest UART transmit queue level seen
+}
+
+/* ADTxxxx - Fade time in ms, 0 goes back to fade rate and fade delay */
+void command_set_fade_time()
+{
+	unsigned char index;
+
+	print_char('s');
+	fade_time = NULL;
+	for(index=3; index<=LAST_CHAR; index++)
+	{
+		fade_time = (fade_time * TEN) + (received_val[index] - ASCII_0);
+	}
+}
+
+/* ADIDCxx - Number of blinks for ADIDDEV */
+void command_set_identify_count()
+{
+	print_char('s');
+	if(input_val != NULL)
+	{
+		identify_count 	= input_val;
+	}
+}
+
+/* ADIDPxx - Blink period for ADIDDEV in 100 ms */
+void command_set_identify_period()
+{
+	print_char('s');
+	if(input_val != NULL)
+	{
+		identify_period = input_val;
+	}
+}
+
+/* ADDBWxx - PIR debounce window in 5 ms samples, 0 is refused */
+void command_set_pir_window()
+{
+	if(command_refuses(SET_PIR_WINDOW, input_val) == YES)
+	{
+		print_char('e');
+		return;
+	}
+	print_char('s');
+	pir_window 		= input_val;
+}
+
+/* ADDBCxx - High PIR samples that confirm motion, 0 is refused. A count above the window is taken as the whole window. */
+void command_set_pir_confirm()
+{
+	if(command_refuses(SET_PIR_CONFIRM, input_val) == YES)
+	{
+		print_char('e');
+		return;
+	}
+	print_char('s');
+	pir_confirm 	= input_val;
+}
+
+/* ADCMTxx - Seconds without a setting command before the settings are written, 0 waits for ADWRFLS */
+void command_set_commit_idle()
+{
+	print_char('s');
+	commit_idle 		= input_val;
+	if(commit_idle == NULL)
+	{
+		commit_countdown = NULL;
+	}
+}
+
+/* ADEVSxx - Runs and longest run in cycles of the handler of event xx */
+void command_get_event_stats()
+{
+	unsigned char stats[4];
+
+	if(input_val < NO_OF_EVENTS)
+	{
+		stats[0] = event_runs[input_val] >> 8;
+		stats[1] = event_runs[input_val];
+		stats[2] = event_max_cycles[input_val] >> 8;
+		stats[3] = event_max_cycles[input_val];
+		send_frame(FRAME_HOST, stats, 4, 4);
+	}
+	else
+	{
+		print_char('e');														// No such event
+	}
+}
+
+/* ADOCRxx - Samples kept and up to OCCUPANCY_CHUNK occupancy samples from cursor xx on, oldest first */
+void command_read_occupancy()
+{
+	unsigned char chunk[OCCUPANCY_CHUNK + 1];
+	unsigned char oldest;
+	unsigned char count;
+
+	oldest = (occupancy_samples < OCCUPANCY_SAMPLES) ? NULL : occupancy_head;
+	chunk[0] = occupancy_samples;
+	for(count = NULL; (count < OCCUPANCY_CHUNK) && ((input_val + count) < occupancy_samples); count++)
+	{
+		chunk[count + 1] = occupancy_history[(oldest + input_val + count) % OCCUPANCY_SAMPLES];
+	}
+	send_frame(FRAME_HOST, chunk, count + 1, 1);
+}
+
+/* ADMTRxx - Energy meter from counter xx on: 0 light output in full light seconds, 1 relay on seconds, 2 relay starts.
+ * An ASCII frame holds counter xx alone: its four escaped bytes use up the character change flags and one counter
+ * keeps the frame in a single BLE notification. Reading all counters in one query needs the binary protocol. */
+void command_read_meter()
+{
+	unsigned char totals[METER_COUNTERS * 4];
+	unsigned long total;
+	unsigned char counter;
+	unsigned char count;
+
+	if(input_val < METER_COUNTERS)
+	{
+		for(counter = NULL; counter < METER_COUNTERS; counter++)
+		{
+			total = config_long(METER_TOTAL(counter)) + meter_counts[counter];
+			totals[counter * 4] 		= total >> 24;
+			totals[(counter * 4) + 1] 	= total >> 16;
+			totals[(counter * 4) + 2] 	= total >> 8;
+			totals[(counter * 4) + 3] 	= total;
+		}
+		count = (protocol_mode == BINARY_PROTOCOL) ? (METER_COUNTERS - input_val) : 1;
+		send_frame(FRAME_HOST, &totals[input_val * 4], count * 4, 4);
+	}
+	else
+	{
+		print_char('e');														// No such counter
+	}
+}
+
+/* ADBINMD - Answer in ASCII, then switch the responses to binary frames */
+void command_set_binary_mode()
+{
+	print_char('s');
+	protocol_mode 		= BINARY_PROTOCOL;
+}
+
+/* ADASCMD - Answer in the current format, then switch the responses back to ASCII */
+void command_set_ascii_mode()
+{
+	print_char('s');
+	protocol_mode 		= ASCII_PROTOCOL;
+}
+
+/* Asks the BLE module for its address without waiting, the reply or the timeout posts EVENT_BLE_ADDRESS */
+void get_ble_address()
+{
+	ble_address_tries--;
+	ble_address_count = NULL;												// Initialize the count of the number of characters received
+	ping_flag = YES;														// Set the ping_flag to receive the BLE address
+	ble_address_wait = BLE_ADDRESS_TIMEOUT + 1;
+	uart_write('p');
+	uart_write('\r');
+}
+
+/*********************************************************************************************************************************
+ * Function name			: handle_ble_address()
+ * Date         			: 17/10/2026
+ * Passing parameters 		: None
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: EVENT_BLE_ADDRESS - The BLE module has sent its address or has not answered within BLE_ADDRESS_TIMEOUT.
+ * 							  The address is decoded into the frame header, or the request is sent again until BLE_ADDRESS_TRIES
+ * 							  requests have gone unanswered, when the address known before is kept. A pending ADDROAD is answered
+ * 							  either way.
+ **********************************************************************************************************************************/
+void handle_ble_address()
+{
+	__disable_interrupt();
+	if((ping_flag == YES) && (ble_address_wait != NULL))
+	{
+		__enable_interrupt();												// Reply still awaited
+		return;
+	}
+	if(ping_flag == YES)
+	{
+		ble_address_count = NULL;											// No complete address in time
+	}
+	ping_flag = NO;															// Reset the ping_flag indicating BLE address are received
+	ble_address_wait = NULL;
+	__enable_interrupt();
+
+	if(ble_address_count < BLE_ADDRESS_LENGTH)
+	{
+		if(ble_address_tries != NULL)
+		{
+			get_ble_address();
+			return;
+		}
+	}
+	else
+	{
+		for(i=NULL; i<BLE_ADDRESS_LENGTH; i++)
+		{
+			BLE_address[i] = hex_to_nibble(BLE_address[i]);					// Convert the received characters to numbers
+		}
+		BLE_address_encrypted[0] = (BLE_address[0] << 4) + BLE_address[1];
+		BLE_address_encrypted[1] = (BLE_address[2] << 4) + BLE_address[3];
+		update_frame_header();
+	}
+
+	if(ble_address_reply == YES)
+	{
+		ble_address_reply 	= NO;
+		current_command 	= RECEIVE_OWN_ADDRESS;
+		print_address(2);
+	}
+}
+
+/* Ends a run of hex characters received while the BLE address is awaited, returns YES if it was the address */
+unsigned char ble_address_run_end()
+{
+	if(ble_address_count == BLE_ADDRESS_LENGTH)
+	{
+		ping_flag = NO;
+		POST_EVENT(EVENT_BLE_ADDRESS);
+		return YES;
+	}
+	ble_address_count = NULL;
+	return NO;
+}
+
+
+/*********************************************************************************************************************************
+ * Function name			: set_duty_cycle(unsigned int Percentage_val)
+ * Date         			: 17/10/2026
+ * Passing parameters 		: unsigned int Percentage_val - light level, 0 to 99 percent
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Looks up the CCR1 value of the level in dimming_curve. Levels above 99 give full light.
+ **********************************************************************************************************************************/
+void set_duty_cycle(unsigned int Percentage_val)
+{
+	if(Percentage_val > MAX_LEVEL)
+	{
+		Percentage_val = MAX_LEVEL;
+	}
+	target_duty = dimming_curve[Percentage_val];
+	POST_EVENT(EVENT_DIMMING);
+	if(target_duty >= DUTY_OFF)											// Manually turn off
+	{
+		isOff = true;
+	}
+	else
+	{
+		isOff = false;
+	}
+	if(sensor_there == true)
+	{
+		OCCUPANCY_TIMER_START();
+	}
+}
+
+/*********************************************************************************************************************************
+ * Function name			: start_fade()
+ * Date         			: 17/10/2026
+ * Passing parameters 		: None
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Switches the load on and lets Timer_A move CCR1 from its present value to target_duty. With a fade
+ * 							  time, that of a recalled scene or else fade_time, the distance is split into a fixed point increment
+ * 							  per PWM period, so every fade takes that time whatever its length. Otherwise each PWM period moves
+ * 							  the step of the former busy loop, which moved fade_rate_val every delay_value iterations.
+ **********************************************************************************************************************************/
+void start_fade()
+{
+	unsigned int distance;
+	unsigned int duration;
+	unsigned long step = MAX_DUTY;
+
+	TA0CCTL0 &= ~CCIE;																// Keep Timer_A out while the fade is set up
+	fade_target = target_duty;
+	duration 	= (scene_fade != NULL) ? (scene_fade * SCENE_FADE_STEP) : fade_time;
+	scene_fade 	= NULL;
+	if(CCR1 == fade_target)
+	{
+		fade_active = NO;
+		return;
+	}
+
+	fade_dim_down 	= (fade_target > CCR1) ? YES : NO;
+	distance 		= (fade_dim_down == YES) ? (fade_target - CCR1) : (CCR1 - fade_target);
+	fade_position 	= (unsigned long)CCR1 << FADE_FRACTION_BITS;
+	if(duration != NULL)
+	{
+		fade_periods 	= ((unsigned long)duration * 1000) / PWM_PERIOD_US;
+		if(fade_periods == 0)
+		{
+			fade_periods = 1;
+		}
+		fade_increment 	= ((unsigned long)distance << FADE_FRACTION_BITS) / fade_periods;
+	}
+	else
+	{
+		if(delay_value != 0)
+		{
+			step = ((unsigned long)fade_rate_val * FADE_DELAY_PER_PERIOD) / delay_value;
+		}
+		if(step == 0)
+		{
+			step = 1;
+		}
+		else if(step > MAX_DUTY)
+		{
+			step = MAX_DUTY;
+		}
+		fade_periods 	= (distance + step - 1) / step;
+		fade_increment 	= step << FADE_FRACTION_BITS;
+	}
+	P2OUT 		|= BIT2;
+	fade_active = YES;
+	TA0CCTL0 	|= CCIE;
+}
+
+/*********************************************************************************************************************************
+ * Function name			: start_identify()
+ * Date         			: 17/10/2026
+ * Passing parameters 		: None
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Starts identify_count blinks of identify_period, each full light then off, timed by Timer_A. A running
+ * 							  fade is held meanwhile. The level and relay state are saved here and restored by Timer_A after the
+ * 							  last blink. Identifying again while blinking restarts the blinks and keeps the saved state.
+ **********************************************************************************************************************************/
+void start_identify()
+{
+	TA0CCTL0 &= ~CCIE;
+	if(identify_phases == NULL)
+	{
+		identify_duty 	= CCR1;
+		identify_relay 	= P2OUT & BIT2;
+	}
+	identify_phases = identify_count * 2;
+	identify_ticks 	= identify_period * (PWM_PERIODS_PER_100_MS / 2);
+	CCR1 			= NULL;														// Full light
+	P2OUT 			|= BIT2;
+	TA0CCTL0 		|= CCIE;
+}
+
+/* Moves CCR1 to the duty straight away, cancelling any fade or identify */
+void set_duty_now(unsigned int duty)
+{
+	fade_active = NO;
+	identify_phases = NULL;
+	target_duty = duty;
+	fade_target = duty;
+	CCR1 		= duty;
+}
+
+/*********************************************************************************************************************************
+ * Function name			: flash_erase()
+ * Date         			: 17/10/2026
+ * Passing parameters 		: None
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Erases the configuration log for a factory reset. Segments that do not count are erased first and the
+ * 							  log segments oldest first, so a power cut part way leaves the newest values or none, never older ones.
+ *********************************************************************************************************************************/
+void flash_erase()
+{
+	unsigned int order[CONFIG_SEGMENTS];
+	unsigned char segments = config_segments(order);
+	unsigned char position;
+	unsigned int segment;
+
+	for(segment = CONFIG_FIRST_SEGMENT; segment < CONFIG_FIRST_SEGMENT + (CONFIG_SEGMENTS * CONFIG_SEGMENT_SIZE); segment += CONFIG_SEGMENT_SIZE)
+	{
+		if(config_sequence(segment) == NULL)
+		{
+			flash_erase_segment(segment);
+		}
+	}
+	for(position = NULL; position < segments; position++)
+	{
+		flash_erase_segment(order[position]);
+	}
+	for(segment = TABLE_FIRST_SEGMENT; segment < TABLE_FIRST_SEGMENT + (TABLE_SEGMENTS * TABLE_SEGMENT_SIZE); segment += TABLE_SEGMENT_SIZE)
+	{
+		flash_erase_segment(segment);
+	}
+	group_bitmap 	= NULL;
+	table_changes 	= NULL;
+	config 			= config_defaults;
+}
+
+/*********************************************************************************************************************************
+ * Function name			: flash_write()
+ * Date         			: 21/6/2017
+ * Passing parameters 		: None
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: This function writes all critical values like sensing freqency, occupancy sensor time out, host address,
+ * 							  commissioning flag status into flash memory. The settings are stored by config_write() and the scene
+ * 							  and group changes kept in RAM by tables_commit(), after the settings so the image is off the stack.
+ *********************************************************************************************************************************/
+void flash_write()
+{
+	config_write();
+	tables_commit();
+}
+
+/* Stores the settings gathered by config_image() with the energy meter counts added, by config_store() */
+void config_write()
+{
+	struct config image;
+
+	config_image(&image);
+	for(i=NULL; i<METER_COUNTERS; i++)
+	{
+		config_set_long((unsigned char *) &image + config_offset[CONFIG_METER_ENERGY + i], config_long(METER_TOTAL(i)) + meter_counts[i]);
+		meter_counts[i] = NULL;
+	}
+	meter_minutes 	= NULL;
+
+	config_store(&image);
+	config_dirty 	= NO;
+}
+
+/* Gathers the settings as they are now in a struct config, the scenes, groups and energy meter totals as they are in the flash */
+void config_image(struct config *image)
+{
+	*image 						= config;
+	image->version 				= CONFIG_VERSION;
+	image->sensing_freq 		= sensing_freq;
+	image->time_out 			= time_out;
+	image->commissioning_flag 	= commissioning_flag;
+	image->fade_rate 			= fade_rate_val;
+	image->power_on_value 		= power_on_value;
+	for(i=NULL; i<4; i++)
+	{
+		image->host_address[i] 				= HOST_address[i];
+		image->polling_host_address[i] 		= POLLING_HOST_address[i];
+	}
+	image->fade_delay[0] 		= temp_delay[0];
+	image->fade_delay[1] 		= temp_delay[1];
+	image->lis_mode 			= lis_mode;
+	image->lis_group_number 	= store_group_value;
+	image->fade_time[0] 		= fade_time;
+	image->fade_time[1] 		= fade_time >> 8;
+	image->commit_idle 			= commit_idle;
+}
+
+/* Returns YES if a setting differs from the flash or a table change is not yet written */
+unsigned char config_changed()
+{
+	struct config image;
+	unsigned char index;
+	const unsigned char *value = (const unsigned char *) &image;
+	const unsigned char *saved = (const unsigned char *) &config;
+
+	config_image(&image);
+	for(index = NULL; (index < sizeof(struct config)) && (value[index] == saved[index]); index++);
+	return ((index < sizeof(struct config)) || (table_changes != NULL)) ? YES : NO;
+}
+
+/*********************************************************************************************************************************
+ * Function name			: meter_save()
+ * Date         			: 17/10/2026
+ * Passing parameters 		: None
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Adds the energy meter counts not yet written to the totals in config and appends a record for each
+ * 							  total that changed. Settings not yet written stay as they are in the flash, so config itself is the
+ * 							  image a new generation takes its snapshot from.
+ *********************************************************************************************************************************/
+void meter_save()
+{
+	unsigned char counter;
+	unsigned char changed[METER_COUNTERS];
+
+	for(counter = NULL; counter < METER_COUNTERS; counter++)
+	{
+		config_set_long(METER_TOTAL(counter), config_long(METER_TOTAL(counter)) + meter_counts[counter]);
+		changed[counter] = (meter_counts[counter] != NULL) ? YES : NO;
+		meter_counts[counter] = NULL;
+	}
+	meter_minutes = NULL;
+	for(counter = NULL; counter < METER_COUNTERS; counter++)
+	{
+		if((changed[counter] == YES) && (config_append(CONFIG_METER_ENERGY + counter, &config) == YES))
+		{
+			break;															// A new generation, its snapshot holds every item
+		}
+	}
+}
+
+/* Value of a four byte item, least significant byte first */
+unsigned long config_long(const unsigned char *value)
+{
+	return value[0] + ((unsigned int) value[1] << 8) + ((unsigned long) value[2] << 16) + ((unsigned long) value[3] << 24);
+}
+
+/* Sets a four byte item, least significant byte first */
+void config_set_long(unsigned char *value, unsigned long number)
+{
+	value[0] = number;
+	value[1] = number >> 8;
+	value[2] = number >> 16;
+	value[3] = number >> 24;
+}
+
+/*********************************************************************************************************************************
+ * Function name			: config_store(const struct config *image)
+ * Date         			: 17/10/2026
+ * Passing parameters 		: image - all values to be kept
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Appends a log record only for the items of image that differ from the copy of the flash in config, so
+ * 							  writing the same configuration again does not touch the flash, and makes image the copy.
+ *********************************************************************************************************************************/
+void config_store(const struct config *image)
+{
+	unsigned char key;
+	unsigned char index;
+	const unsigned char *value;
+	const unsigned char *saved;
+
+	for(key = NULL; key < NO_OF_CONFIG_ITEMS; key++)
+	{
+		value = (const unsigned char *) image + config_offset[key];
+		saved = (const unsigned char *) &config + config_offset[key];
+		for(index = NULL; (index < config_length[key]) && (value[index] == saved[index]); index++);
+		if(index < config_length[key])
+		{
+			if(config_append(key, image) == YES)
+			{
+				break;														// A new generation, its snapshot holds every item
+			}
+		}
+	}
+	config = *image;
+}
+
+/* Erases the flash segment at address */
+void flash_erase_segment(unsigned int address)
+{
+	unsigned char *Flash_ptr = HAL_FLASH(address);
+
+	FCTL1 = FWKEY + ERASE;                    										// Set Erase bit
+	FCTL3 = FWKEY;                            										// Clear Lock bit
+	HAL_FLASH_ERASE(Flash_ptr);                										// Dummy write to erase Flash segment
+	FCTL1 = FWKEY;                            										// Clear WRT bit
+	FCTL3 = FWKEY + LOCK;                     										// Set LOCK bits
+}
+
+/* Writes length bytes from data to the erased flash at address */
+void flash_program(unsigned int address, const unsigned char *data, unsigned char length)
+{
+	unsigned char *Flash_ptr = HAL_FLASH(address);
+
+	FCTL3 = FWKEY;                            										// Clear Lock bit
+	FCTL1 = FWKEY + WRT;                      										// Set WRT bit for write operation
+	while(length--)
+	{
+		HAL_FLASH_WRITE(Flash_ptr++, *data++);
+	}
+	FCTL1 = FWKEY;                            										// Clear WRT bit
+	FCTL3 = FWKEY + LOCK;                     										// Set LOCK bits
+}
+
+/* Sequence number of a log segment, 0 if its header is not complete */
+unsigned int config_sequence(unsigned int segment)
+{
+	unsigned int sequence = flash_read(segment) + (flash_read(segment + 1) << 8);
+	unsigned int check = flash_read(segment + 2) + (flash_read(segment + 3) << 8);
+
+	if((sequence == NULL) || (sequence == 0xFFFF) || ((sequence ^ check) != 0xFFFF))
+	{
+		return NULL;
+	}
+	return sequence;
+}
+
+/*********************************************************************************************************************************
+ * Function name			: config_segments(unsigned int *order)
+ * Date         			: 17/10/2026
+ * Passing parameters 		: order - filled with the addresses of the log segments
+ * Returning parameters 	: Number of log segments
+ * Author 					: Suhas K V
+ * Description 				: Finds the segments with a complete header and sorts them oldest first by their sequence number.
+ *********************************************************************************************************************************/
+unsigned char config_segments(unsigned int *order)
+{
+	unsigned int sequence[CONFIG_SEGMENTS];
+	unsigned int segment;
+	unsigned int number;
+	unsigned char count = NULL;
+	unsigned char position;
+
+	for(segment = CONFIG_FIRST_SEGMENT; segment < CONFIG_FIRST_SEGMENT + (CONFIG_SEGMENTS * CONFIG_SEGMENT_SIZE); segment += CONFIG_SEGMENT_SIZE)
+	{
+		number = config_sequence(segment);
+		if(number != NULL)
+		{
+			for(position = count; (position > 0) && (sequence[position - 1] > number); position--)
+			{
+				order[position] 	= order[position - 1];
+				sequence[position] 	= sequence[position - 1];
+			}
+			order[position] 	= segment;
+			sequence[position] 	= number;
+			count++;
+		}
+	}
+	return count;
+}
+
+/* Copies length bytes of configuration values */
+void config_copy(unsigned char *destination, const unsigned char *source, unsigned char length)
+{
+	while(length--)
+	{
+		*destination++ = *source++;
+	}
+}
+
+/* Check of a record, never erased flash so a record cut short before its check always fails */
+unsigned int config_check(const unsigned char *data, unsigned char length)
+{
+	unsigned int check = crc16(data, length);
+
+	return (check == 0xFFFF) ? 0xFFFE : check;
+}
+
+/* Length of the record at record, 0 at free space, a record past end or a failed check */
+unsigned char config_record_length(unsigned int record, unsigned int end)
+{
+	const unsigned char *data = HAL_FLASH(record);
+	unsigned int length;
+
+	if((data[0] == CONFIG_FREE) || ((record + CONFIG_RECORD_OVERHEAD) > end))
+	{
+		return NULL;
+	}
+	length = data[1] + CONFIG_RECORD_OVERHEAD;
+	if(((record + length) > end) || (config_check(data, length - CONFIG_CHECK_SIZE) != ((data[length - 2] << 8) | data[length - 1])))
+	{
+		return NULL;
+	}
+	return length;
+}
+
+/* First free address after the records of a segment ending at end, 0 if its log ends in a damaged record */
+unsigned int config_tail(unsigned int segment, unsigned int end)
+{
+	unsigned int record = segment + CONFIG_HEADER_SIZE;
+	unsigned char length;
+
+	while((length = config_record_length(record, end)) != NULL)
+	{
+		record += length;
+	}
+	if((record < end) && (flash_read(record) != CONFIG_FREE))
+	{
+		return NULL;
+	}
+	return record;
+}
+
+/* Position in order of the newest segment starting with a snapshot, segments if there is none */
+unsigned char config_base(const unsigned int *order, unsigned char segments)
+{
+	unsigned char position = segments;
+	unsigned int record;
+
+	while(position-- > 0)
+	{
+		record = order[position] + CONFIG_HEADER_SIZE;
+		if((flash_read(record) == CONFIG_SNAPSHOT) && (config_record_length(record, order[position] + CONFIG_SEGMENT_SIZE) != NULL))
+		{
+			return position;
+		}
+	}
+	return segments;
+}
+
+/*********************************************************************************************************************************
+ * Function name			: config_load()
+ * Date         			: 17/10/2026
+ * Passing parameters 		: None
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Loads config in one pass: the default image, then the snapshot of the present generation, then its
+ * 							  item records in log order. A snapshot of an older version is migrated by taking the fields of its
+ * 							  layout and leaving the ones added since at their defaults. A snapshot of a newer version, or one
+ * 							  whose length does not match its version, is not taken, and the item records of the generation are
+ * 							  applied to the defaults. Records of items this firmware does not know, or of another length, are
+ * 							  skipped. Nodes without a log are migrated from the former segment C layout.
+ *********************************************************************************************************************************/
+void config_load()
+{
+	unsigned int order[CONFIG_SEGMENTS];
+	unsigned char segments = config_segments(order);
+	unsigned char position;
+	unsigned char length;
+	unsigned char key;
+	unsigned char index;
+	unsigned int record;
+	const unsigned char *data;
+
+	config = config_defaults;
+	if(segments == NULL)
+	{
+		for(key = NULL; key < NO_OF_CONFIG_ITEMS; key++)
+		{
+			for(index = NULL; index < config_length[key]; index++)
+			{
+				record = config_legacy_address[key] + (index * config_legacy_step[key]);
+				if((config_legacy_address[key] != NULL) && (flash_read(record) != CONFIG_FREE))
+				{
+					((unsigned char *) &config)[config_offset[key] + index] = flash_read(record);
+				}
+			}
+		}
+		return;
+	}
+
+	for(position = config_base(order, segments); position < segments; position++)
+	{
+		record = order[position] + CONFIG_HEADER_SIZE;
+		while((length = config_record_length(record, order[position] + CONFIG_SEGMENT_SIZE)) != NULL)
+		{
+			data = HAL_FLASH(record);
+			if(data[0] == CONFIG_SNAPSHOT)
+			{
+				if((data[2] != NULL) && (data[2] <= CONFIG_VERSION) && (data[1] == config_version_size[data[2]]))
+				{
+					config_copy((unsigned char *) &config, &data[2], data[1]);
+				}
+			}
+			else if((data[0] < NO_OF_CONFIG_ITEMS) && (data[1] == config_length[data[0]]))
+			{
+				config_copy((unsigned char *) &config + config_offset[data[0]], &data[2], data[1]);
+			}
+			record += length;
+		}
+	}
+	config.version = CONFIG_VERSION;
+}
+
+/*********************************************************************************************************************************
+ * Function name			: config_append(unsigned char key, const struct config *image)
+ * Date         			: 17/10/2026
+ * Passing parameters 		: key - configuration item
+ * 							  image - all values, the item and a snapshot are taken from it
+ * Returning parameters 	: YES if a new generation was started, its snapshot holding every item of image
+ * Author 					: Suhas K V
+ * Description 				: Writes a record at the end of the newest log segment. When the record does not fit or the segment
+ * 							  ends in a damaged record the log moves on to the next segment first. The check is written
+ * 							  last, so the record counts only once it is complete.
+ *********************************************************************************************************************************/
+unsigned char config_append(unsigned char key, const struct config *image)
+{
+	unsigned int order[CONFIG_SEGMENTS];
+	unsigned char record[CONFIG_MAX_LENGTH + CONFIG_RECORD_OVERHEAD];
+	unsigned char length = config_length[key];
+	unsigned char segments;
+	unsigned int tail = NULL;
+	unsigned int check;
+
+	record[0] = key;
+	record[1] = length;
+	config_copy(&record[2], (const unsigned char *) image + config_offset[key], length);
+	check 				= config_check(record, length + 2);
+	record[length + 2] 	= check >> 8;
+	record[length + 3] 	= check;
+	length += CONFIG_RECORD_OVERHEAD;
+
+	segments = config_segments(order);
+	if(segments != NULL)
+	{
+		tail = config_tail(order[segments - 1], order[segments - 1] + CONFIG_SEGMENT_SIZE);
+		if((tail != NULL) && ((tail + length) > (order[segments - 1] + CONFIG_SEGMENT_SIZE)))
+		{
+			tail = NULL;
+		}
+	}
+	if(tail == NULL)
+	{
+		if(config_rotate(order, segments, image) == YES)
+		{
+			return YES;
+		}
+		segments = config_segments(order);
+		tail = order[segments - 1] + CONFIG_HEADER_SIZE;
+	}
+	flash_program(tail, record, length);
+	return NO;
+}
+
+/*********************************************************************************************************************************
+ * Function name			: config_rotate(const unsigned int *order, unsigned char segments, const struct config *image)
+ * Date         			: 17/10/2026
+ * Passing parameters 		: order, segments - the log segments, oldest first
+ * 							  image - all values
+ * Returning parameters 	: YES if the new segment starts a generation with a snapshot of image, NO if it goes on with the
+ * 							  present one
+ * Author 					: Suhas K V
+ * Description 				: Erases a free segment, or else the oldest segment outside the present generation, and makes it the
+ * 							  newest log segment. If it is the last such segment, or there is no generation yet, a snapshot is put
+ * 							  in first. The header goes in last, so a power cut leaves the log as it was.
+ *********************************************************************************************************************************/
+unsigned char config_rotate(const unsigned int *order, unsigned char segments, const struct config *image)
+{
+	unsigned char header[CONFIG_HEADER_SIZE];
+	unsigned char base = config_base(order, segments);
+	unsigned char snapshot;
+	unsigned int sequence = 1;
+	unsigned int target;
+	unsigned int tail;
+	unsigned int check;
+
+	if(segments != NULL)
+	{
+		sequence = config_sequence(order[segments - 1]) + 1;
+	}
+	snapshot = ((base == segments) || ((CONFIG_SEGMENTS - segments + base) == 1)) ? YES : NO;
+	if(segments < CONFIG_SEGMENTS)
+	{
+		for(target = CONFIG_FIRST_SEGMENT; config_sequence(target) != NULL; target += CONFIG_SEGMENT_SIZE);
+	}
+	else
+	{
+		target = order[0];
+	}
+
+	flash_erase_segment(target);
+	if(snapshot == YES)
+	{
+		tail 		= target + CONFIG_HEADER_SIZE;
+		header[0] 	= CONFIG_SNAPSHOT;
+		header[1] 	= sizeof(struct config);
+		flash_program(tail, header, 2);
+		flash_program(tail + 2, (const unsigned char *) image, sizeof(struct config));
+		check 		= config_check(HAL_FLASH(tail), sizeof(struct config) + 2);
+		header[0] 	= check >> 8;
+		header[1] 	= check;
+		flash_program(tail + sizeof(struct config) + 2, header, CONFIG_CHECK_SIZE);
+	}
+
+	config_write_header(target, sequence);
+	return snapshot;
+}
+
+/* Writes the header that makes segment count, after everything else in it */
+void config_write_header(unsigned int segment, unsigned int sequence)
+{
+	unsigned char header[CONFIG_HEADER_SIZE];
+
+	header[0] = sequence;
+	header[1] = sequence >> 8;
+	header[2] = ~sequence;
+	header[3] = (~sequence) >> 8;
+	flash_program(segment, header, CONFIG_HEADER_SIZE);
+}
+
+/* Newest table log segment, 0 if neither has a complete header */
+unsigned int table_segment()
+{
+	unsigned int first = config_sequence(TABLE_FIRST_SEGMENT);
+	unsigned int second = config_sequence(TABLE_FIRST_SEGMENT + TABLE_SEGMENT_SIZE);
+
+	if(first == second)
+	{
+		return NULL;															// Both 0, a sequence number is never in both
+	}
+	return (first > second) ? TABLE_FIRST_SEGMENT : (TABLE_FIRST_SEGMENT + TABLE_SEGMENT_SIZE);
+}
+
+/* Address of the newest record of key in a table log segment, 0 if there is none */
+unsigned int table_record(unsigned int segment, unsigned char key)
+{
+	unsigned int record = segment + CONFIG_HEADER_SIZE;
+	unsigned int found = NULL;
+	unsigned char length;
+
+	while((length = config_record_length(record, segment + TABLE_SEGMENT_SIZE)) != NULL)
+	{
+		if(flash_read(record) == key)
+		{
+			found = record;
+		}
+		record += length;
+	}
+	return found;
+}
+
+/* Address of the values of the newest table of key, 0 if none is stored */
+unsigned int table_find(unsigned char key)
+{
+	unsigned int segment = table_segment();
+	unsigned int record = NULL;
+
+	if(segment != NULL)
+	{
+		record = table_record(segment, key);
+	}
+	return (record != NULL) ? (record + 2) : NULL;
+}
+
+/*********************************************************************************************************************************
+ * Function name			: table_write(const unsigned char *record, unsigned char length)
+ * Date         			: 17/10/2026
+ * Passing parameters 		: record - key, number of values and the values of a table
+ * 							  length - bytes in record
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Appends a table to the newest table log segment. When it does not fit the other segment is erased,
+ * 							  the table and the newest record of each other table copied in, and the next sequence number written
+ * 							  once they are complete. The check of each record is written last. group_bitmap is found again
+ * 							  afterwards, as the record it pointed to may have moved.
+ *********************************************************************************************************************************/
+void table_write(const unsigned char *record, unsigned char length)
+{
+	static const unsigned char table_key[NO_OF_TABLES] = {SCENE_TABLE, GROUP_TABLE};
+	unsigned char check[CONFIG_CHECK_SIZE];
+	unsigned char index;
+	unsigned char rotate = NO;
+	unsigned int segment = table_segment();
+	unsigned int previous = NULL;
+	unsigned int tail = NULL;
+	unsigned int copy;
+
+	if(segment != NULL)
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 254;                    											// TX -> RXed character
-		char_change_flag |= 0x04;
+		tail = config_tail(segment, segment + TABLE_SEGMENT_SIZE);
+		if((tail != NULL) && ((tail + length + CONFIG_CHECK_SIZE) > (segment + TABLE_SEGMENT_SIZE)))
+		{
+			tail = NULL;
+		}
 	}
-	else if(checksum == 13)
+	if(tail == NULL)
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 255;                    											// TX -> RXed character
-		char_change_flag |= 0x04;
+		rotate 		= YES;
+		previous 	= segment;
+		segment 	= (segment == TABLE_FIRST_SEGMENT) ? (TABLE_FIRST_SEGMENT + TABLE_SEGMENT_SIZE) : TABLE_FIRST_SEGMENT;
+		tail 		= segment + CONFIG_HEADER_SIZE;
+		flash_erase_segment(segment);
 	}
-	else
+	check[0] = config_check(record, length) >> 8;
+	check[1] = config_check(record, length);
+	flash_program(tail, record, length);
+	flash_program(tail + length, check, CONFIG_CHECK_SIZE);
+	if(rotate == YES)
+	{
+		tail += length + CONFIG_CHECK_SIZE;
+		for(index = NULL; (previous != NULL) && (index < NO_OF_TABLES); index++)
+		{
+			copy = table_record(previous, table_key[index]);
+			if((table_key[index] != record[0]) && (copy != NULL))
+			{
+				length = flash_read(copy + 1) + CONFIG_RECORD_OVERHEAD;
+				flash_program(tail, HAL_FLASH(copy), length);
+				tail += length;
+			}
+		}
+		config_write_header(segment, (previous == NULL) ? 1 : (config_sequence(previous) + 1));
+	}
+	group_bitmap = HAL_FLASH(table_find(GROUP_TABLE));
+}
+
+/* Level and fade time of a scene, read from the scene table at table or without one from the former scenes 1 to 5 */
+void scene_read(unsigned int table, unsigned char scene, unsigned char *entry)
+{
+	entry[0] = SCENE_CLEARED;
+	entry[1] = NULL;
+	if(table != NULL)
+	{
+		entry[0] = flash_read(table + (scene * SCENE_ENTRY_SIZE));
+		entry[1] = flash_read(table + (scene * SCENE_ENTRY_SIZE) + 1);
+	}
+	else if((scene >= 1) && (scene <= 5) && (config.scenes[scene - 1] <= MAX_LEVEL))
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = checksum;                    											// TX -> RXed character
+		entry[0] = config.scenes[scene - 1];
 	}
+}
 
-	while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-	UCA0TXBUF = char_change_flag;                    											// TX -> RXed character
+/* Values of the change of a scene or group of the table key not yet written, NULL if there is none */
+unsigned char *table_pending_find(unsigned char key, unsigned char index)
+{
+	unsigned char change;
 
-	while (!(IFG2&UCA0TXIFG));                											// USCI_A0 TX buffer ready?
-	UCA0TXBUF = '\n';
-	while (!(IFG2&UCA0TXIFG));                											// USCI_A0 TX buffer ready?
-	UCA0TXBUF = '\r';
-	__delay_cycles(1);
-	char_change_flag = UNITY;
+	for(change = NULL; change < table_changes; change++)
+	{
+		if((table_pending[change][0] == key) && (table_pending[change][1] == index))
+		{
+			return &table_pending[change][2];
+		}
+	}
+	return NULL;
 }
 
 /*********************************************************************************************************************************
- * Function name			: print_address(unsigned int isHostAddress)
- * Date         			: 21/6/2017
- * Passing parameters 		: unsigned int isHostAddress
+ * Function name			: table_change(unsigned char key, unsigned char index, unsigned char value0, unsigned char value1)
+ * Date         			: 17/10/2026
+ * Passing parameters 		: key - SCENE_TABLE or GROUP_TABLE
+ * 							  index - scene or group changed
+ * 							  value0, value1 - its new values
  * Returning parameters 	: None
- * Author 					: Subrahmanya K S and Suhas K V
- * Description 				: This function will accept the address parameter. Based on the parameter it will send the required
- * 							  address through BLE.
- **********************************************************************************************************************************/
-void print_address(unsigned int isHostAddress)
+ * Author 					: Suhas K V
+ * Description 				: Keeps a table change in RAM until the settings are written, so that it goes to the flash with them.
+ * 							  A scene or group changed again has its values replaced. With TABLE_PENDING changes kept the tables
+ * 							  are written at once to make room. A new entry is filled before it is counted, for the receive
+ * 							  interrupt reading it.
+ *********************************************************************************************************************************/
+void table_change(unsigned char key, unsigned char index, unsigned char value0, unsigned char value1)
 {
-	for(i=0; i<2; i++)
+	unsigned char *values = table_pending_find(key, index);
+
+	if(values == NULL)
 	{
-		while (!(IFG2&UCA0TXIFG));                									// USCI_A0 TX buffer ready?
-		UCA0TXBUF = send_msg[i];                    								// TX -> RXed character
+		if(table_changes >= TABLE_PENDING)
+		{
+			tables_commit();
+		}
+		table_pending[table_changes][0] = key;
+		table_pending[table_changes][1] = index;
+		values = &table_pending[table_changes][2];
+		values[0] = value0;
+		values[1] = value1;
+		table_changes++;
+		return;
 	}
+	values[0] = value0;
+	values[1] = value1;
+}
+
+/* Writes the table of key with its changes not yet written, unless it is stored and would not change */
+void table_commit(unsigned char key)
+{
+	unsigned char record[SCENE_TABLE_SIZE + 2];
+	unsigned char length = SCENE_TABLE_SIZE;
+	unsigned char index;
+	unsigned int stored = table_find(key);
 
-	if(isHostAddress == 1)
+	record[0] = key;
+	if(key == GROUP_TABLE)
 	{
-		for(i=NULL; i<4; i++)
+		length = GROUP_BITMAP_SIZE;
+		for(index = NULL; index < GROUP_BITMAP_SIZE; index++)
+		{
+			record[2 + index] = NULL;
+		}
+		for(index = NULL; index < BROADCAST_ADDRESS; index++)
 		{
-			while (!(IFG2&UCA0TXIFG));                									// USCI_A0 TX buffer ready?
-			UCA0TXBUF = POLLING_HOST_address[i];                    							// TX -> RXed character
+			if(group_member(index) == YES)
+			{
+				record[2 + GROUP_BYTE(index)] |= GROUP_BIT(index);
+			}
 		}
 	}
-	else if(isHostAddress == 2)
+	else
 	{
-		for(i=NULL; i<4; i++)
+		for(index = NULL; index < SCENES; index++)
 		{
-			while (!(IFG2&UCA0TXIFG));                									// USCI_A0 TX buffer ready?
-			UCA0TXBUF = HOST_address[i];                    							// TX -> RXed character
+			scene_entry(index, &record[2 + (index * SCENE_ENTRY_SIZE)]);
 		}
 	}
+	record[1] = length;
+	for(index = NULL; (stored != NULL) && (index < length) && (record[2 + index] == flash_read(stored + index)); index++);
+	if((stored == NULL) || (index < length))
+	{
+		table_write(record, length + 2);
+	}
+}
 
-	while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-	UCA0TXBUF = ' ';                    											// TX -> RXed character
+/* Writes the tables with changes not yet written and forgets the changes */
+void tables_commit()
+{
+	unsigned char change;
+	unsigned char scenes = NO;
+	unsigned char groups = NO;
 
-	for(i=NULL; i<2; i++)
+	for(change = NULL; change < table_changes; change++)
 	{
-		if(BLE_address_encrypted[i] == 10)
+		if(table_pending[change][0] == SCENE_TABLE)
+		{
+			scenes = YES;
+		}
+		else
 		{
-			while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-			UCA0TXBUF = 254;                    											// TX -> RXed character
-			char_change_flag |= (0x80 - (i * 0x40));
+			groups = YES;
 		}
-		else if(BLE_address_encrypted[i] == 13)
+	}
+	if(scenes == YES)
+	{
+		table_commit(SCENE_TABLE);
+	}
+	if(groups == YES)
+	{
+		table_commit(GROUP_TABLE);
+	}
+	table_changes = NULL;
+}
+
+/* Level and fade time of a scene, with its change not yet written if there is one */
+void scene_entry(unsigned char scene, unsigned char *entry)
+{
+	const unsigned char *pending = table_pending_find(SCENE_TABLE, scene);
+
+	if(pending != NULL)
+	{
+		entry[0] = pending[0];
+		entry[1] = pending[1];
+		return;
+	}
+	scene_read(table_find(SCENE_TABLE), scene, entry);
+}
+
+/*********************************************************************************************************************************
+ * Function name			: scene_write(unsigned char scene, const unsigned char *entry)
+ * Date         			: 17/10/2026
+ * Passing parameters 		: scene - 0 to SCENES - 1
+ * 							  entry - level with SCENE_RELAY_OFF and fade time
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Changes one scene. The change is kept by table_change() and the scene table written with the
+ * 							  settings by the idle commit or ADWRFLS. A scene that would not change is left alone.
+ *********************************************************************************************************************************/
+void scene_write(unsigned char scene, const unsigned char *entry)
+{
+	unsigned char before[SCENE_ENTRY_SIZE];
+
+	scene_entry(scene, before);
+	if((before[0] != entry[0]) || (before[1] != entry[1]))
+	{
+		table_change(SCENE_TABLE, scene, entry[0], entry[1]);
+	}
+}
+
+/*********************************************************************************************************************************
+ * Function name			: scene_command(unsigned char operation)
+ * Date         			: 17/10/2026
+ * Passing parameters 		: operation - SCENE_STORE, SCENE_GET, SCENE_RECALL or SCENE_CLEAR
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Runs a scene command on scene input_val. Storing takes the present level, fade time and relay state.
+ * 							  Reading sends the level with SCENE_RELAY_OFF and the fade time in 100 ms in binary mode, and in ASCII
+ * 							  the single level byte of the former scenes, 0 for a scene stored with the load off. Recalling fades
+ * 							  to the level over the fade time of the scene, or switches the load off for a scene stored with it
+ * 							  off. A scene out of range is answered with 'e'.
+ *********************************************************************************************************************************/
+void scene_command(unsigned char operation)
+{
+	unsigned char entry[SCENE_ENTRY_SIZE];
+
+	if(command_refuses(SET_SCENE_NUMBER, input_val) == YES)
+	{
+		print_char('e');														// No such scene
+		return;
+	}
+	if(operation != SCENE_GET)
+	{
+		print_char('s');														// Send acknowledgement
+	}
+	scene_entry(input_val, entry);
+	switch(operation)
+	{
+	case SCENE_STORE:
+		entry[0] = ((percentage_val > MAX_LEVEL) ? MAX_LEVEL : percentage_val) | ((isOff == true) ? SCENE_RELAY_OFF : NULL);
+		entry[1] = ((fade_time / SCENE_FADE_STEP) > 0xFF) ? 0xFF : (fade_time / SCENE_FADE_STEP);
+		scene_write(input_val, entry);
+		break;
+	case SCENE_GET:
+		if(protocol_mode == BINARY_PROTOCOL)
 		{
-			while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-			UCA0TXBUF = 255;                    											// TX -> RXed character
-			char_change_flag |= (0x80 - (i * 0x40));
+			send_frame(FRAME_HOST, entry, SCENE_ENTRY_SIZE, SCENE_ENTRY_SIZE);
 		}
 		else
 		{
-			while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-			UCA0TXBUF = BLE_address_encrypted[i];                    											// TX -> RXed character
+			print_val1((entry[0] & SCENE_RELAY_OFF) ? NULL : entry[0], 2);
 		}
+		break;
+	case SCENE_RECALL:
+		percentage_val 	= (entry[0] & SCENE_RELAY_OFF) ? NULL : (entry[0] & ~SCENE_RELAY_OFF);
+		scene_fade 		= entry[1];
+		set_duty_cycle(percentage_val);
+		break;
+	case SCENE_CLEAR:
+		entry[0] = SCENE_CLEARED;
+		entry[1] = NULL;
+		scene_write(input_val, entry);
+		break;
+	default:
+		break;
+	}
+}
+
+/*********************************************************************************************************************************
+ * Function name			: group_write(unsigned char group, unsigned char member)
+ * Date         			: 17/10/2026
+ * Passing parameters 		: group - 0 to BROADCAST_ADDRESS - 1, others change nothing
+ * 							  member - YES to join the group, NO to leave it
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Changes one group. The change is kept by table_change() and the bitmap written with the settings by
+ * 							  the idle commit or ADWRFLS, taking in the former groups of struct config when none is stored yet. A
+ * 							  group that would not change is left alone.
+ *********************************************************************************************************************************/
+void group_write(unsigned char group, unsigned char member)
+{
+	if((group < BROADCAST_ADDRESS) && (group_member(group) != member))
+	{
+		table_change(GROUP_TABLE, group, member, NULL);
 	}
+}
 
-	while (!(IFG2&UCA0TXIFG));              	 				 				// USCI_A0 TX buffer ready?
-	UCA0TXBUF = DEVICE_TYPE;				                    				// TX -> RXed character
+/* Returns YES if the node is in group, with its change not yet written or without a stored bitmap from the former groups */
+unsigned char group_member(unsigned char group)
+{
+	const unsigned char *pending = table_pending_find(GROUP_TABLE, group);
+	unsigned char index;
 
-	checksum = BLE_address_encrypted[0]
-				+ BLE_address_encrypted[1] + DEVICE_TYPE;
-	if(checksum == 10)
+	if(group >= BROADCAST_ADDRESS)
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 254;                    											// TX -> RXed character
-		char_change_flag |= 0x10;
+		return NO;																// GROUP_NONE marks the free former slots
 	}
-	else if(checksum == 13)
+	if(pending != NULL)
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 255;                    											// TX -> RXed character
-		char_change_flag |= 0x10;
+		return pending[0];
 	}
-	else
+	if(group_bitmap != NULL)
+	{
+		return (group_bitmap[GROUP_BYTE(group)] & GROUP_BIT(group)) ? YES : NO;
+	}
+	for(index = NULL; index < 5; index++)
+	{
+		if(config.groups[index] == group)
+		{
+			return YES;
+		}
+	}
+	return NO;
+}
+
+/*********************************************************************************************************************************
+ * Function name			: flash_read(unsigned int address)
+ * Date         			: 21/6/2017
+ * Passing parameters 		: unsigned int address
+ * Returning parameters 	: return_val
+ * Author 					: Suhas K V
+ * Description 				: This function reads all critical values like sensing freqency, occupancy sensor time out, host address,
+ * 							  commissioning flag status into flash memory. This does not take any parameter nor return any.
+ *********************************************************************************************************************************/
+unsigned char flash_read(unsigned int address)
+{
+	char *Flash_ptr;                          										// Flash pointer
+	unsigned char return_val;
+	Flash_ptr = (char *) HAL_FLASH(address);   										// Initialize Flash pointer
+	return_val = *Flash_ptr;
+	return return_val;
+}
+
+
+/*********************************************************************************************************************************
+ * Function name			: uart_write(unsigned char character)
+ * Date         			: 17/10/2026
+ * Passing parameters 		: unsigned char character
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Queues a character for transmission and returns. USCI0TX_ISR sends the queued characters, so the CPU
+ * 							  can go back to sleep while the response goes out. Waits only when the queue is full.
+ **********************************************************************************************************************************/
+void uart_write(unsigned char character)
+{
+	unsigned char next = (tx_head + 1) & (TX_BUFFER_SIZE - 1);
+	unsigned char level;
+
+	while(next == tx_tail)														// Queue full, wait for the ISR to send a character
+	{
+		HAL_WAIT();
+	}
+	tx_buffer[tx_head] = character;
+	tx_head = next;
+
+	level = (tx_head - tx_tail) & (TX_BUFFER_SIZE - 1);
+	if(level > tx_high_water)
+	{
+		tx_high_water = level;
+	}
+	IE2 |= UCA0TXIE;															// Start or keep the transmit interrupt running
+}
+
+/*********************************************************************************************************************************
+ * Function name			: escape_byte(unsigned char value, unsigned char flag_bit, unsigned char *flags)
+ * Date         			: 17/10/2026
+ * Passing parameters 		: unsigned char value, unsigned char flag_bit, unsigned char *flags
+ * Returning parameters 	: Byte to be sent
+ * Author 					: Suhas K V
+ * Description 				: Replaces \n and \r with 254 and 255 so that they never appear inside a frame, and marks the byte in
+ * 							  the character change flag sent at the end of the frame.
+ **********************************************************************************************************************************/
+unsigned char escape_byte(unsigned char value, unsigned char flag_bit, unsigned char *flags)
+{
+	if(value == 10)
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = checksum;                    											// TX -> RXed character
+		*flags |= flag_bit;
+		value = 254;
 	}
-	checksum = checksum >> 8;
-	if(checksum == 10)
+	else if(value == 13)
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 254;                    											// TX -> RXed character
-		char_change_flag |= 0x08;
+		*flags |= flag_bit;
+		value = 255;
 	}
-	else if(checksum == 13)
+	return value;
+}
+
+/*********************************************************************************************************************************
+ * Function name			: update_frame_header()
+ * Date         			: 17/10/2026
+ * Passing parameters 		: None
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Builds the "D <host address> <BLE address>" header of both response types with the BLE address
+ * 							  already escaped, along with its character change flags and checksum. Must be called whenever the
+ * 							  host, polling host or BLE address changes.
+ **********************************************************************************************************************************/
+void update_frame_header()
+{
+	unsigned char ble_byte;
+
+	frame_header_flag = UNITY;
+	for(i=NULL; i<SEND_MSG_LENGTH; i++)
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 255;                    											// TX -> RXed character
-		char_change_flag |= 0x08;
+		frame_header[FRAME_HOST][i] 		= send_msg[i];
+		frame_header[FRAME_POLLING_HOST][i] = send_msg[i];
 	}
-	else
+	for(i=NULL; i<4; i++)
+	{
+		frame_header[FRAME_HOST][SEND_MSG_LENGTH + i] 			= HOST_address[i];
+		frame_header[FRAME_POLLING_HOST][SEND_MSG_LENGTH + i] 	= POLLING_HOST_address[i];
+	}
+	frame_header[FRAME_HOST][SEND_MSG_LENGTH + 4] 			= ' ';
+	frame_header[FRAME_POLLING_HOST][SEND_MSG_LENGTH + 4] 	= ' ';
+	for(i=NULL; i<2; i++)
+	{
+		ble_byte = escape_byte(BLE_address_encrypted[i], 0x80 >> i, &frame_header_flag);
+		frame_header[FRAME_HOST][SEND_MSG_LENGTH + 5 + i] 			= ble_byte;
+		frame_header[FRAME_POLLING_HOST][SEND_MSG_LENGTH + 5 + i] 	= ble_byte;
+	}
+	frame_header_checksum = BLE_address_encrypted[0] + BLE_address_encrypted[1];
+}
+
+/*********************************************************************************************************************************
+ * Function name			: send_frame(unsigned char header, const unsigned char *payload, unsigned char length,
+ * 							  unsigned char escaped_count)
+ * Date         			: 17/10/2026
+ * Passing parameters 		: header - FRAME_HOST or FRAME_POLLING_HOST
+ * 							  payload, length - bytes to be sent after the header
+ * 							  escaped_count - number of leading payload bytes that are escaped
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Queues a complete response frame: cached header, payload, 16 bit additive checksum, character change
+ * 							  flag and "\n\r". Escaped payload bytes take the flag bits from 0x20 downwards and the checksum bytes
+ * 							  the next two. The first payload byte always owns bit 0x20, even when it is not escaped. In binary mode
+ * 							  the payload is sent as a binary frame instead. Nothing is sent while a batch runs.
+ **********************************************************************************************************************************/
+void send_frame(unsigned char header, const unsigned char *payload, unsigned char length, unsigned char escaped_count)
+{
+	unsigned char flags = frame_header_flag;
+	unsigned char flag_bit = 0x20;
+
+	if(response_muted == YES)
+	{
+		return;
+	}
+	if(protocol_mode == BINARY_PROTOCOL)
+	{
+		send_binary_frame(header, payload, length);
+		return;
+	}
+	checksum = frame_header_checksum;
+	for(i=NULL; i<FRAME_HEADER_LENGTH; i++)
+	{
+		uart_write(frame_header[header][i]);
+	}
+	for(i=NULL; i<length; i++)
+	{
+		checksum += payload[i];
+		if(i < escaped_count)
+		{
+			uart_write(escape_byte(payload[i], flag_bit, &flags));
+			flag_bit >>= 1;
+		}
+		else
+		{
+			uart_write(payload[i]);
+		}
+	}
+	if(escaped_count == 0)
+	{
+		flag_bit >>= 1;
+	}
+	uart_write(escape_byte(checksum, flag_bit, &flags));
+	uart_write(escape_byte(checksum >> 8, flag_bit >> 1, &flags));
+	uart_write(flags);
+	uart_write('\n');
+	uart_write('\r');
+}
+
+/*********************************************************************************************************************************
+ * Function name			: send_binary_frame(unsigned char header, const unsigned char *payload, unsigned char length)
+ * Date         			: 17/10/2026
+ * Passing parameters 		: header - FRAME_HOST or FRAME_POLLING_HOST
+ * 							  payload, length - response bytes
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Queues a binary response: the route part of the cached header followed by the COBS encoded BLE
+ * 							  address, opcode of the command being answered, length, payload and CRC-16.
+ **********************************************************************************************************************************/
+void send_binary_frame(unsigned char header, const unsigned char *payload, unsigned char length)
+{
+	unsigned char frame[BINARY_RESPONSE_SIZE];
+	unsigned char index;
+	unsigned int crc;
+
+	for(index=NULL; index<FRAME_ROUTE_LENGTH; index++)
+	{
+		uart_write(frame_header[header][index]);
+	}
+	frame[0] = BLE_address_encrypted[0];
+	frame[1] = BLE_address_encrypted[1];
+	frame[2] = current_command;
+	frame[3] = length;
+	for(index=NULL; index<length; index++)
+	{
+		frame[index + 4] = payload[index];
+	}
+	length += BINARY_RESPONSE_OVERHEAD - CRC_LENGTH;
+	crc = crc16(frame, length);
+	frame[length] 		= crc >> 8;
+	frame[length + 1] 	= crc;
+	send_cobs(frame, length + CRC_LENGTH, COBS_RESPONSE_DELIMITER);
+}
+
+/* CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF), computed a nibble at a time */
+unsigned int crc16(const unsigned char *data, unsigned char length)
+{
+	unsigned int crc = CRC16_INIT;
+	unsigned char index;
+
+	for(index=NULL; index<length; index++)
+	{
+		crc = ((crc << 4) ^ crc16_table[((crc >> 12) ^ (data[index] >> 4)) & 0x0F]) & 0xFFFF;
+		crc = ((crc << 4) ^ crc16_table[((crc >> 12) ^ data[index]) & 0x0F]) & 0xFFFF;
+	}
+	return crc;
+}
+
+/*********************************************************************************************************************************
+ * Function name			: cobs_decode(unsigned char *buffer, unsigned char length, unsigned char delimiter)
+ * Date         			: 17/10/2026
+ * Passing parameters 		: buffer, length - encoded frame without its delimiter, decoded in place
+ * 							  delimiter - byte value removed by the encoding
+ * Returning parameters 	: Decoded length, 0 if the frame is not valid COBS
+ * Author 					: Suhas K V
+ * Description 				: Each code byte (XORed with the delimiter) gives the distance to the next delimiter byte of the
+ * 							  original frame. The decoded frame is never longer than the encoded one, so it is written in place.
+ **********************************************************************************************************************************/
+unsigned char cobs_decode(unsigned char *buffer, unsigned char length, unsigned char delimiter)
+{
+	unsigned char read = NULL;
+	unsigned char write = NULL;
+	unsigned char code;
+	unsigned char index;
+
+	while(read < length)
 	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = checksum;                    											// TX -> RXed character
+		code = buffer[read++] ^ delimiter;
+		if((code == 0) || (code - 1 > length - read))
+		{
+			return NULL;
+		}
+		for(index=1; index<code; index++)
+		{
+			buffer[write++] = buffer[read++];
+		}
+		if((code != 0xFF) && (read < length))
+		{
+			buffer[write++] = delimiter;
+		}
 	}
+	return write;
+}
+
+/*********************************************************************************************************************************
+ * Function name			: send_cobs(const unsigned char *data, unsigned char length, unsigned char delimiter)
+ * Date         			: 17/10/2026
+ * Passing parameters 		: data, length - frame to be sent, shorter than 254 bytes
+ * 							  delimiter - byte value that must not appear inside the frame
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Queues the frame COBS encoded, followed by the delimiter. Every block of the frame up to the next
+ * 							  delimiter byte is sent behind a code byte holding its length plus one, XORed with the delimiter.
+ **********************************************************************************************************************************/
+void send_cobs(const unsigned char *data, unsigned char length, unsigned char delimiter)
+{
+	unsigned char start = NULL;
+	unsigned char end;
+
+	do
+	{
+		for(end=start; (end < length) && (data[end] != delimiter); end++);
+		uart_write((end - start + 1) ^ delimiter);
+		for(; start<end; start++)
+		{
+			uart_write(data[start]);
+		}
+		start++;																	// Skip the delimiter byte
+	} while(start <= length);
+	uart_write(delimiter);
+}
+
+/*********************************************************************************************************************************
+ * Function name			: print_val1(unsigned int Value, unsigned int polling_host)
+ * Date         			: 21/6/2017
+ * Passing parameters 		: unsigned int Value
+ * Returning parameters 	: None
+ * Author 					: Subrahmanya K S and Suhas K V
+ * Description 				: This function will accept the value to be sent out through BLE and sends it to the destination address.
+ **********************************************************************************************************************************/
+void print_val1(unsigned int Value, unsigned int polling_host)
+{
+	unsigned char payload = Value;
+
+	send_frame((polling_host == 1) ? FRAME_POLLING_HOST : FRAME_HOST, &payload, 1, 1);
+}
+
+/*********************************************************************************************************************************
+ * Function name			: print_setting()
+ * Date         			: 21/6/2017
+ * Passing parameters 		: None
+ * Returning parameters 	: None
+ * Author 					: Subrahmanya K S and Suhas K V
+ * Description 				: This function will send the sensing frequency and occupnacy sensor time out out through BLE and sends
+ * 							  it to the destination address.
+ **********************************************************************************************************************************/
+void print_setting()
+{
+	unsigned char payload[5];
 
-	while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-	UCA0TXBUF = char_change_flag;                    											// TX -> RXed character
-	while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-	UCA0TXBUF = '\n';
-	while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-	UCA0TXBUF = '\r';
-	char_change_flag = UNITY;
+	time_out = max_timer_count / _1_MIN;											// Calculate the time out value
+	payload[0] = time_out;
+	payload[1] = power_on_value;
+	payload[2] = fade_rate_val;
+	payload[3] = temp_delay[0];
+	payload[4] = temp_delay[1];
+	send_frame(FRAME_HOST, payload, 5, 2);
 }
 
 /*********************************************************************************************************************************
- * Function name			: print_char(unsigned int character)
+ * Function name			: print_address(unsigned int isHostAddress)
  * Date         			: 21/6/2017
- * Passing parameters 		: unsigned int character
+ * Passing parameters 		: unsigned int isHostAddress
  * Returning parameters 	: None
  * Author 					: Subrahmanya K S and Suhas K V
  * Description 				: This function will accept the address parameter. Based on the parameter it will send the required
  * 							  address through BLE.
  **********************************************************************************************************************************/
-void print_char(unsigned char character)
+void print_address(unsigned int isHostAddress)
 {
-	for(i=0; i<2; i++)
-	{
-		while (!(IFG2&UCA0TXIFG));               			 						// USCI_A0 TX buffer ready?
-		UCA0TXBUF = send_msg[i];                    								// TX -> RXed character
-	}
-
-	for(i=NULL; i<4; i++)
-	{
-		while (!(IFG2&UCA0TXIFG));                									// USCI_A0 TX buffer ready?
-		UCA0TXBUF = HOST_address[i];                    							// TX -> RXed character
-	}
-
-	while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-	UCA0TXBUF = ' ';                    											// TX -> RXed character
-
-	for(i=NULL; i<2; i++)
-	{
-		if(BLE_address_encrypted[i] == 10)
-		{
-			while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-			UCA0TXBUF = 254;                    											// TX -> RXed character
-			char_change_flag |= (0x80 - (i * 0x40));
-		}
-		else if(BLE_address_encrypted[i] == 13)
-		{
-			while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-			UCA0TXBUF = 255;                    											// TX -> RXed character
-			char_change_flag |= (0x80 - (i * 0x40));
-		}
-		else
-		{
-			while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-			UCA0TXBUF = BLE_address_encrypted[i];                    											// TX -> RXed character
-		}
-	}
-
-	while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-	UCA0TXBUF = character;                    										// TX -> RXed character
-
-	checksum = BLE_address_encrypted[0] + BLE_address_encrypted[1] + character;
-	if(checksum == 10)
-	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 254;                    											// TX -> RXed character
-		char_change_flag |= 0x10;
-	}
-	else if(checksum == 13)
-	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 255;                    											// TX -> RXed character
-		char_change_flag |= 0x10;
-	}
-	else
-	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = checksum;                    											// TX -> RXed character
-	}
-
-	checksum = checksum >> 8;
-	if(checksum == 10)
-	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 254;                    											// TX -> RXed character
-		char_change_flag |= 0x08;
-	}
-	else if(checksum == 13)
-	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = 255;                    											// TX -> RXed character
-		char_change_flag |= 0x08;
-	}
-	else
-	{
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = checksum;                    											// TX -> RXed character
-	}
+	unsigned char payload = DEVICE_TYPE;
 
-	while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-	UCA0TXBUF = char_change_flag;                    											// TX -> RXed character
+	send_frame((isHostAddress == 1) ? FRAME_POLLING_HOST : FRAME_HOST, &payload, 1, 0);
+}
 
-	while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-	UCA0TXBUF = '\n';
-	while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-	UCA0TXBUF = '\r';
-	__delay_cycles(1);
-	char_change_flag = UNITY;
+/*********************************************************************************************************************************
+ * Function name			: print_char(unsigned int character)
+ * Date         			: 21/6/2017
+ * Passing parameters 		: unsigned int character
+ * Returning parameters 	: None
+ * Author 					: Subrahmanya K S and Suhas K V
+ * Description 				: This function will send a single character, usually the 's' acknowledgement or the 'e' of a
+ * 							  refused command, to the host address.
+ **********************************************************************************************************************************/
+void print_char(unsigned char character)
+{
+	send_frame(FRAME_HOST, &character, 1, 0);
 }
 
 void print_command(int lis_value)
 {
 	for(i=0; i<2; i++)
 	{
-		while (!(IFG2&UCA0TXIFG));                									// USCI_A0 TX buffer ready?
-		UCA0TXBUF = send_msg[i];                    								// TX -> RXed character
+		uart_write(send_msg[i]);
 	}
 
 	for(i=NULL; i<4; i++)
 	{
-		while (!(IFG2&UCA0TXIFG));                									// USCI_A0 TX buffer ready?
-		UCA0TXBUF = '0';
+		uart_write('0');
 	}
 
-	while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-	UCA0TXBUF = ' ';                    											// TX -> RXed character
+	uart_write(' ');
 
 	if(lis_value == 0)
 	{
 		for(i=NULL; i<5; i++)
 		{
-			while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-			UCA0TXBUF = LIS_command[i] ;                    											// TX -> RXed character
+			uart_write(LIS_command[i]);
 		}
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = '0';                    											// TX -> RXed character
+		uart_write('0');
 
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = '0';                    											// TX -> RXed character
+		uart_write('0');
 
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = store_group_value;                    											// TX -> RXed character
+		uart_write(store_group_value);
 	}
 	else if(lis_value == 1)
 	{
 		for(i=NULL; i<5; i++)
 		{
-			while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-			UCA0TXBUF = LIS_command[i] ;                    											// TX -> RXed character
+			uart_write(LIS_command[i]);
 		}
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = '9';                    											// TX -> RXed character
+		uart_write('9');
 
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = '9';                    											// TX -> RXed character
+		uart_write('9');
 
-		while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-		UCA0TXBUF = store_group_value;                    											// TX -> RXed character
+		uart_write(store_group_value);
 	}
 
-	while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-	UCA0TXBUF = '\n';
-	while (!(IFG2&UCA0TXIFG));                										// USCI_A0 TX buffer ready?
-	UCA0TXBUF = '\r';                    											// TX -> RXed character
+	uart_write('\n');
+	uart_write('\r');
 
 }
 
@@ -1804,10 +3369,15 @@ void print_command(int lis_value)
  * Passing parameters 		: None
  * Returning parameters 	: None
  * Author 					: Suhas K V
- * Description 				: This function is used to intialise BCS clock and DCO clock. Frequency of clock is set to 8MHz.
+ * Description 				: This function is used to intialise BCS clock and DCO clock. Frequency of clock is set to 8MHz. ACLK
+ * 							  runs from the VLO, whose frequency is measured against the DCO, and the watchdog interval timer is
+ * 							  started on it for the checkpoints of the time outs.
  **********************************************************************************************************************************/
 void CLOCK_INIT()
 {
+	unsigned int start;
+	unsigned char cycles;
+
 	if (CALBC1_8MHZ==0xFF)															// If calibration constant erasedd
 	{
 		while(true);                               									// do not load, trap CPU!!
@@ -1815,6 +3385,29 @@ void CLOCK_INIT()
 	DCOCTL = 0;                               										// Select lowest DCOx and MODx settings
 	BCSCTL1 = CALBC1_8MHZ;                    										// Set DCO
 	DCOCTL = CALDCO_8MHZ;
+	BCSCTL3 |= LFXT1S_2;															// ACLK from the VLO for the time outs
+
+	/* Time VLO_CALIBRATION_CYCLES ACLK cycles with SMCLK, Timer1 CCR0 captures ACLK on CCI0B */
+	TA1CTL = TASSEL_2 + MC_2 + TACLR;
+	TA1CCTL0 = CM_1 + CCIS_1 + CAP;
+	while((TA1CCTL0 & CCIFG) == 0)
+	{
+		HAL_WAIT();
+	}
+	start = TA1CCR0;
+	for(cycles = NULL; cycles < VLO_CALIBRATION_CYCLES; cycles++)
+	{
+		TA1CCTL0 &= ~CCIFG;
+		while((TA1CCTL0 & CCIFG) == 0)
+		{
+			HAL_WAIT();
+		}
+	}
+	vlo_frequency = (SMCLK_HZ * VLO_CALIBRATION_CYCLES) / ((TA1CCR0 - start) & 0xFFFF);
+	TA1CCTL0 = NULL;
+
+	WDTCTL = WDT_ADLY_250;															// Checkpoint every ACLK_CHECKPOINT ACLK cycles
+	IE1 |= WDTIE;
 }
 
 /*********************************************************************************************************************************
@@ -1844,17 +3437,54 @@ void UART_INIT()
  * Passing parameters 		: None
  * Returning parameters 	: None
  * Author 					: Suhas K V
- * Description 				: This function is used to intialise TIMER0 peripherals of the microcontroller. Timer for occupancy
- * 							  sensor is initialised and interrupt is enabled.
+ * Description 				: This function is used to intialise TIMER0 peripherals of the microcontroller for the PWM output and
+ * 							  to start the occupancy sensor time out.
  **********************************************************************************************************************************/
 void TIMER_INIT()
 {
-	/* Occupancy sensor timer */
 	TA0CTL |= (TASSEL_2 + MC_1 + ID_3);												// Use clock at 1 MHz
-	TA0CCTL0 |= CCIE;																// Enable Occupancy sensor timer interrupt
 	TA0CCR0 = PWM_WIDTH;															// Value for 300 Hz PWM frequency
 	TA0CCR1 = NULL;
 	TA0CCTL1 = OUTMOD_3;
+	OCCUPANCY_TIMER_START();
+}
+
+/*********************************************************************************************************************************
+ * Function name			: low_power_mode()
+ * Date         			: 17/10/2026
+ * Passing parameters 		: None
+ * Returning parameters 	: LPM3_bits when nothing needs SMCLK, LPM0_bits otherwise
+ * Author 					: Suhas K V
+ * Description 				: Called with interrupts disabled just before main sleeps. SMCLK is needed by a fade or identify blink,
+ * 							  a queued UART transmission, the Timer1 gap, repeat filter and PIR debounce timers and the PWM of a
+ * 							  dimmed load. A load at full light needs no PWM, so its output is held high and main restores
+ * 							  OUTMOD_3 on waking. The USCI turns SMCLK on by itself at a start edge, so the first character is
+ * 							  received in LPM3, and the receive interrupt then keeps SMCLK on for the rest of the frame. The
+ * 							  interrupts that end SMCLK work wake main so that it can sleep deeper.
+ **********************************************************************************************************************************/
+unsigned int low_power_mode()
+{
+	if((fade_active == YES) || (identify_phases != NULL) || (tx_tail != tx_head) || (UCA0STAT & UCBUSY)
+			|| (TA1CCTL0 & CCIE) || (TA1CCTL2 & CCIE))
+	{
+		return LPM0_bits;
+	}
+	if(P2OUT & BIT2)
+	{
+		if(CCR1 != NULL)
+		{
+			return LPM0_bits;														// Dimmed load needs the PWM
+		}
+		TA0CCTL1 = OUTMOD_0 + OUT;													// Full light, hold the output high
+	}
+	return LPM3_bits;
+}
+
+/* Restarts the occupancy time out, counted in the watchdog interval checkpoints */
+void OCCUPANCY_TIMER_START()
+{
+	timer_int_count = NULL;
+	occupancy_timer_on = YES;
 }
 
 /*********************************************************************************************************************************
@@ -1863,13 +3493,11 @@ void TIMER_INIT()
  * Passing parameters 		: None
  * Returning parameters 	: None
  * Author 					: Suhas K V
- * Description 				: This function is used to disable TIMER0 peripherals of the microcontroller. Disables the occupancy sensor
- * 							  timer.
+ * Description 				: Disables the occupancy sensor time out. The PWM keeps running.
  **********************************************************************************************************************************/
 void TIMER_DISABLE()
 {
-	TA0CTL &= ~MC_2;																// Stop Timer 0 clock
-	TA0CCTL0 &= ~CCIE;																// Disable Occupancy sensor timer interrupt
+	occupancy_timer_on = NO;														// Stop the occupancy time out
 }
 
 /*********************************************************************************************************************************
@@ -1878,14 +3506,13 @@ void TIMER_DISABLE()
  * Passing parameters 		: None
  * Returning parameters 	: None
  * Author 					: Suhas K V
- * Description 				: This function is used to intialise TIMER1 peripherals of the microcontroller. Timer for
- * 							  Request mode is initialised and interrupt is enabled.
+ * Description 				: This function is used to intialise TIMER1 peripherals of the microcontroller, which time the UART
+ * 							  gaps and PIR debounce, and to start the sensing frequency count of request mode.
  **********************************************************************************************************************************/
 void REQUEST_MODE_TIMER_INIT()
 {
 	TA1CTL 	|= (TASSEL_2 + MC_2);													// Use clock at 8 MHz
-	TA1CCTL1 |= CCIE;																// Enable request mode timer interrupt
-	TA1CCR1 = 0xFFFF;
+	sensing_timer_on = YES;															// Count the sensing frequency in the checkpoints
 }
 
 /* Disable request mode timer */
@@ -1899,7 +3526,7 @@ void REQUEST_MODE_TIMER_INIT()
  **********************************************************************************************************************************/
 void REQUEST_MODE_TIMER_DISABLE()
 {
-	TA1CCTL1 &= ~CCIE;																// Disable request mode timer interrupt
+	sensing_timer_on = NO;															// Disable request mode timer
 }
 
 /*********************************************************************************************************************************
@@ -1938,6 +3565,30 @@ void PORT_OUT_INIT()
 	P2SEL |= BIT6;
 }
 
+/*********************************************************************************************************************************
+ * Function name			: SUPPLY_MONITOR_INIT()
+ * Date         			: 17/10/2026
+ * Passing parameters 		: None
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Lets Checkpoint_timer measure VCC at every checkpoint. ADC10 and its reference are only on for the
+ * 							  conversion, which runs from ADC10OSC and so also in LPM3.
+ **********************************************************************************************************************************/
+void SUPPLY_MONITOR_INIT()
+{
+	supply_low 		= NO;
+	supply_monitor 	= YES;
+}
+
+/* Starts a conversion of VCC/2, Supply_sag() takes the result */
+void SUPPLY_SAMPLE()
+{
+	ADC10CTL0 &= ~ENC;
+	ADC10CTL1 = INCH_11 + ADC10DIV_7;													// VCC/2, ADC10OSC / 8
+	ADC10CTL0 = SREF_1 + ADC10SHT_3 + REFON + REF2_5V + ADC10ON + ADC10IE;
+	ADC10CTL0 |= ENC + ADC10SC;
+}
+
 void ADC_INIT()
 {
 	ADC10CTL0 = ADC10SHT_2 + ADC10ON + ADC10IE; // ADC10ON, interrupt enabled
@@ -1966,189 +3617,366 @@ void FLASH_INIT()
 }
 
 
+/*********************************************************************************************************************************
+ * Function name			: SYS_INIT()
+ * Date         			: 21/6/2017
+ * Passing parameters 		: None
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: Loads the settings from the flash in one pass and sets up the node from them. A time out, fade rate or
+ * 							  fade delay of 0 is not usable and falls back to its default.
+ **********************************************************************************************************************************/
 void SYS_INIT()
 {
-	if(flash_read(FLASH_GROUP_ONE) != 0xff)
-	{
-		group_array[0] = flash_read(FLASH_GROUP_ONE);
-	}
-	if(flash_read(FLASH_GROUP_TWO) != 0xff)
-	{
-		group_array[1] = flash_read(FLASH_GROUP_TWO);
-	}
-	if(flash_read(FLASH_GROUP_THREE) != 0xff)
-	{
-		group_array[2] = flash_read(FLASH_GROUP_THREE);
-	}
-	if(flash_read(FLASH_GROUP_FOUR) != 0xff)
-	{
-		group_array[3] = flash_read(FLASH_GROUP_FOUR);
-	}
-	if(flash_read(FLASH_GROUP_FIVE) != 0xff)
-	{
-		group_array[4] = flash_read(FLASH_GROUP_FIVE);
-	}
+	config_load();
 
-	if(flash_read(FLASH_HOST_ADDRESS) != 0xff)								// Read the host address from the flash memory if something is written in it
+	group_bitmap = HAL_FLASH(table_find(GROUP_TABLE));
+	for(i=NULL; i<4; i++)
 	{
-		HOST_address[0] = flash_read(FLASH_HOST_ADDRESS_1);
-		HOST_address[1] = flash_read(FLASH_HOST_ADDRESS_2);
-		HOST_address[2] = flash_read(FLASH_HOST_ADDRESS_3);
-		HOST_address[3] = flash_read(FLASH_HOST_ADDRESS_4);
+		HOST_address[i] 			= config.host_address[i];
+		POLLING_HOST_address[i] 	= config.polling_host_address[i];
 	}
 
-	if(flash_read(FLASH_POLLING_HOST_ADDRESS) != 0xff)								// Read the host address from the flash memory if something is written in it
-	{
-		POLLING_HOST_address[0] = flash_read(FLASH_POLLING_HOST_ADDRESS_1);
-		POLLING_HOST_address[1] = flash_read(FLASH_POLLING_HOST_ADDRESS_2);
-		POLLING_HOST_address[2] = flash_read(FLASH_POLLING_HOST_ADDRESS_3);
-		POLLING_HOST_address[3] = flash_read(FLASH_POLLING_HOST_ADDRESS_4);
-	}
+	sensing_freq 		= config.sensing_freq;
+	sensing_freq_val 	= CHECKPOINTS(sensing_freq);							// Calculate sensing frequency
+
+	time_out 			= (config.time_out != NULL) ? config.time_out : config_defaults.time_out;
+	max_timer_count 	= time_out * _1_MIN;									// Convert the value in minutes
+	minute_interval 	= _1_MIN;
+
+	commissioning_flag 	= config.commissioning_flag;
+	fade_rate_val 		= (config.fade_rate != NULL) ? config.fade_rate : config_defaults.fade_rate;
+
+	power_on_value 		= config.power_on_value;
+	percentage_val 		= power_on_value;
+	set_duty_cycle(percentage_val);												// Same curve as the ADSPL command
 
-	if(flash_read(FLASH_ADDRESS_SENSING_FREQ) != 0xff)						// Read the sensing frequency from the flash memory if something is written in it
+	temp_delay[0] 		= config.fade_delay[0];
+	temp_delay[1] 		= config.fade_delay[1];
+	delay_value 		= ((temp_delay[0] * 10) + (temp_delay[1] * 1)) * 10;
+	if(delay_value == 0)
 	{
-		sensing_freq = flash_read(FLASH_ADDRESS_SENSING_FREQ);
+		temp_delay[0] 	= config_defaults.fade_delay[0];
+		temp_delay[1] 	= config_defaults.fade_delay[1];
+		delay_value 	= ((temp_delay[0] * 10) + (temp_delay[1] * 1)) * 10;
 	}
-	sensing_freq_val = (sensing_freq * 1000000)/8192;							// Calculate sensing frequency
 
 
-	if(((flash_read(FLASH_ADDRESS_TIME_OUT)) != 0xff) 						// Read the time out value of the occupancy sensor from the flash memory is something is
-			&& ((flash_read(FLASH_ADDRESS_TIME_OUT)) != 0x00))				// written in it and if that value is not zero
+	store_group_value 	= config.lis_group_number;
+	lis_mode 			= config.lis_mode;
+	fade_time 			= config.fade_time[0] + (config.fade_time[1] << 8);
+
+	commit_idle 		= config.commit_idle;
+	SUPPLY_MONITOR_INIT();
+}
+
+/*********************************************************************************************************************************
+ * Interrupt name			: USCI0RX_ISR()
+ * Date         			: 21//62017
+ * Passing parameters 		: None
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: This interrupt service routine is invoked when THE BLE module sends the data through UART. Characters
+ * 							  are framed as they arrive: an ASCII frame starts with "AD" and is complete after MAX_CHAR characters.
+ * 							  In binary mode any other first character starts a COBS frame which is complete at the 0 delimiter.
+ * 							  Complete frames are left in rx_buffer behind a length byte for main() and the CPU is woken up, so the
+ * 							  next frame can be received while the current one is executed. A frame in progress is dropped by
+ * 							  Timer_A2 when the line is idle for RX_GAP_TIMEOUT. While the BLE address is awaited, frames are
+ * 							  received as usual and a run of exactly BLE_ADDRESS_LENGTH hex characters outside a frame, ended by
+ * 							  another character or the idle line, is taken as the address.
+ **********************************************************************************************************************************/
+#pragma vector=USCIAB0RX_VECTOR
+__interrupt void USCI0RX_ISR(void)
+{
+	received_char = HAL_UART_RECEIVE();												// Reading the buffer clears UCA0RXIFG
+	if(ping_flag == YES)															// BLE address response, frames are still received
 	{
-		time_out = flash_read(FLASH_ADDRESS_TIME_OUT);
-		max_timer_count = time_out * _1_MIN;							// Convert the value in minutes
+		if(IS_HEX(received_char) && ((ble_address_count != NULL) || (character_count == 0)))	// Never starts in a frame
+		{
+			if(ble_address_count < BLE_ADDRESS_LENGTH)
+			{
+				BLE_address[ble_address_count] = received_char;
+			}
+			if(ble_address_count <= BLE_ADDRESS_LENGTH)
+			{
+				ble_address_count++;												// One more marks a run too long
+			}
+		}
+		else if(ble_address_run_end() == YES)
+		{
+			__bic_SR_register_on_exit(LPM3_bits);
+		}
 	}
-
-	if(flash_read(FLASH_ADDRESS_COM_FLAG) != 0xff)							// Check if the sensor has been commissioned, if it is then the commissioning flag will be 1
+	if(character_count == 0)
 	{
-		commissioning_flag = flash_read(FLASH_ADDRESS_COM_FLAG);
+		rx_binary_frame = (protocol_mode == BINARY_PROTOCOL) && (received_char != 'A');
 	}
-
-	if(((flash_read(FLASH_FADE_RATE_VALUE) != 0xff))					// Something's written in the flash memory
-			&& ((flash_read(FLASH_FADE_RATE_VALUE)) != 0x00))
+	if((rx_binary_frame == NO) && (received_char == 0 || received_char == 13 		// Filter the junk and invalid characters
+								|| received_char == 10 || received_char == 255))
 	{
-		fade_rate_val = flash_read(FLASH_FADE_RATE_VALUE);
+		return;
 	}
 
-	if((flash_read(FLASH_PERCENTAGE_VALUE)) != 0xff)			// Something's written in the flash memory
+	TA1CTL 	|= (TASSEL_2 + MC_2);													// Use clock at 8 MHz
+	TA1CCR0 = TA1R + RX_GAP_TIMEOUT;												// Restart the inter-character gap timer
+	TA1CCTL0 = CCIE;
+	__bic_SR_register_on_exit(SCG1 + SCG0);											// Keep SMCLK on for Timer1 if woken from LPM3
+
+	if(rx_binary_frame == YES)
 	{
-		power_on_value = flash_read(FLASH_PERCENTAGE_VALUE);
-		percentage_val = power_on_value;
-		percent_normalize = 100 - power_on_value;			// To make 0% as min and 100% as max
-		// (Otherwise 0% would be max and 100% would be min)
-		case_value = MAX_DUTY * 0.01;						// To convert the value into percentage
-		target_duty = case_value * percent_normalize;
-		if(target_duty >= 3300)
+		if(received_char == COBS_REQUEST_DELIMITER)
+		{
+			if(character_count != 0)												// Frame complete, hand it to main program
+			{
+				rx_buffer[rx_frame_start] = character_count | BINARY_FRAME_FLAG;
+				character_count = NULL;
+				rx_frame_start = rx_head;
+				rx_frames_received++;
+				POST_EVENT(EVENT_UART_FRAME);
+				__bic_SR_register_on_exit(LPM3_bits);
+			}
+			return;
+		}
+		if(character_count == BINARY_FRAME_SIZE)									// Too long, drop the frame
 		{
-			isOff = 1;
+			rx_head = rx_frame_start;
+			character_count = NULL;
+			return;
 		}
 	}
-
-	if(flash_read(FLASH_FADE_DELAY_VALUE) != 0xff)								// Read the host address from the flash memory if something is written in it
+	else
 	{
-		temp_delay[0] = flash_read(FLASH_FADE_DELAY_VALUE_1);
-		temp_delay[1] = flash_read(FLASH_FADE_DELAY_VALUE_2);
-
-		delay_value = ((temp_delay[0] * 10) + (temp_delay[1] * 1)) * 10;
-		if(delay_value == 0)
+		if((character_count == 1) && (received_char != 'D'))						// Not a frame, look for the next start
+		{
+			rx_head = rx_frame_start;
+			character_count = NULL;
+		}
+		if((character_count == 0) && (received_char != 'A'))
 		{
-			delay_value = 300;
-			temp_delay[0] = 3;
-			temp_delay[1] = 0;
+			return;
 		}
 	}
 
-	/* Group values and scene numbers are to be read from flash here */
-	if(flash_read(FLASH_SCENE_ONE) != 0xff)
+	if(((rx_tail - rx_head - 1) & (RX_BUFFER_SIZE - 1)) < ((character_count == 0) ? 2 : 1))
 	{
-		scene_one = flash_read(FLASH_SCENE_ONE);
+		rx_head = rx_frame_start;													// Queue full, drop the frame
+		character_count = NULL;
+		rx_overruns++;
+		return;
 	}
-	if(flash_read(FLASH_SCENE_TWO) != 0xff)
+	if(character_count == 0)
 	{
-		scene_two = flash_read(FLASH_SCENE_TWO);
+		rx_head = (rx_head + 1) & (RX_BUFFER_SIZE - 1);								// Leave room for the length byte
 	}
-	if(flash_read(FLASH_SCENE_THREE) != 0xff)
+	rx_buffer[rx_head] = received_char;
+	rx_head = (rx_head + 1) & (RX_BUFFER_SIZE - 1);
+	character_count++;
+
+	if((rx_binary_frame == NO) && (character_count == MAX_CHAR))					// Frame complete, hand it to main program
 	{
-		scene_three = flash_read(FLASH_SCENE_THREE);
+		rx_buffer[rx_frame_start] = MAX_CHAR;
+		character_count = NULL;
+		rx_frame_start = rx_head;
+		rx_frames_received++;
+		POST_EVENT(EVENT_UART_FRAME);
+		__bic_SR_register_on_exit(LPM3_bits);
 	}
-	if(flash_read(FLASH_SCENE_FOUR) != 0xff)
+}
+
+/*********************************************************************************************************************************
+ * Interrupt name			: USCI0TX_ISR()
+ * Date         			: 17/10/2026
+ * Passing parameters 		: None
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: This interrupt service routine sends the next queued character whenever the UART transmit buffer is
+ * 							  empty. The interrupt is disabled once the queue is empty.
+ **********************************************************************************************************************************/
+#pragma vector=USCIAB0TX_VECTOR
+__interrupt void USCI0TX_ISR(void)
+{
+	if(tx_tail != tx_head)
 	{
-		scene_four = flash_read(FLASH_SCENE_FOUR);
+		HAL_UART_SEND(tx_buffer[tx_tail]);											// Writing the buffer clears UCA0TXIFG
+		tx_tail = (tx_tail + 1) & (TX_BUFFER_SIZE - 1);
 	}
-	if(flash_read(FLASH_SCENE_FIVE) != 0xff)
+	if(tx_tail == tx_head)
 	{
-		scene_five = flash_read(FLASH_SCENE_FIVE);
+		IE2 &= ~UCA0TXIE;															// Nothing left to send
+		__bic_SR_register_on_exit(LPM3_bits);										// Let main sleep deeper
 	}
+}
 
-	if(flash_read(FLASH_LIS_GROUP_NUMBER) != 0xff)
+/*********************************************************************************************************************************
+ * Interrupt name			: Timer_A ()
+ * Date         			: 21/6/2017
+ * Passing parameters 		: None
+ * Returning parameters 	: None
+ * Author 					: Suhas K V
+ * Description 				: This interrupt service routine is invoked at the start of every PWM period while a fade or identify
+ * 							  runs. It runs the identify blinks or moves CCR1 one fade step towards fade_target, switching the load
+ * 							  off at the end of a fade to off. The interrupt is disabled when neither is running.
+ **********************************************************************************************************************************/
+#pragma vector=TIMER0_A0_VECTOR
+__interrupt void Timer_A (void)
+{
+	if(identify_phases != NULL)
+	{
+		identify_ticks--;
+		if(identify_ticks == 0)
+		{
+			identify_phases--;
+			if(identify_phases == 0)												// Done, back to the level before identifying
+			{
+				CCR1 = identify_duty;
+				P2OUT = (P2OUT & ~BIT2) | identify_relay;
+				P1IFG &= ~BIT5;														// Clear the PIR flag set by relay noise
+				POST_EVENT(EVENT_DIMMING);											// Let main start a fade held back meanwhile
+				__bic_SR_register_on_exit(LPM3_bits);
+			}
+			else
+			{
+				P2OUT ^= BIT2;														// Next half blink
+				identify_ticks = identify_period * (PWM_PERIODS_PER_100_MS / 2);
+			}
+		}
+	}
+	else if(fade_active == YES)
 	{
-		store_group_value = flash_read(FLASH_LIS_GROUP_NUMBER);
+		if(fade_periods > 1)
+		{
+			if(fade_dim_down == YES)
+			{
+				fade_position += fade_increment;
+			}
+			else
+			{
+				fade_position -= fade_increment;
+			}
+			CCR1 = fade_position >> FADE_FRACTION_BITS;
+			fade_periods--;
+		}
+		else																		// Last period lands exactly on the target
+		{
+			CCR1 = fade_target;
+			fade_active = NO;
+			if(isOff == true)
+			{
+				P2OUT &= ~BIT2;
+			}
+		}
 	}
 
-	if(flash_read(FLASH_LIS_MODE) != 0xff)
+	if((fade_active == NO) && (identify_phases == NULL))
 	{
-		lis_mode 			= flash_read(FLASH_LIS_MODE);
+		TA0CCTL0 &= ~CCIE;
+		__bic_SR_register_on_exit(LPM3_bits);										// Let main sleep deeper
 	}
 }
 
 /*********************************************************************************************************************************
- * Interrupt name			: USCI0RX_ISR()
- * Date         			: 21//62017
+ * Interrupt name			: Checkpoint_timer()
+ * Date         			: 17/10/2026
  * Passing parameters 		: None
  * Returning parameters 	: None
  * Author 					: Suhas K V
- * Description 				: This interrupt service routine is invoked when THE BLE module sends the data through UART. Once it
- * 							  reads the command it wakes up the CPU.
+ * Description 				: This interrupt service routine is invoked every ACLK_CHECKPOINT ACLK cycles by the watchdog interval
+ * 							  timer, also in LPM3. It will check whether the occupancy time out, the sensing time, the idle period
+ * 							  before an automatic flash write, the wait for the BLE address or a minute is over. If yes, wake up
+ * 							  the CPU. It also counts the minute statistics, counts down the PIR warm-up and starts the
+ * 							  measurement of the supply monitor.
  **********************************************************************************************************************************/
-#pragma vector=USCIAB0RX_VECTOR
-__interrupt void USCI0RX_ISR(void)
+#pragma vector=WDT_VECTOR
+__interrupt void Checkpoint_timer(void)
 {
-	received_char = UCA0RXBUF;														// Store the received character in a variable
-	if (received_char == 0 || received_char == 13 || received_char == 10			// Filter the junk and invalid characters
-													|| received_char == 255 )
+	if(occupancy_timer_on == YES)
 	{
-		IFG2 &= ~UCA0RXIFG;
-		return;
+		minute_occupied++;
+		timer_int_count++;															// increment timer entry count
+		if (timer_int_count >= max_timer_count)
+		{
+			POST_EVENT(EVENT_OCCUPANCY_TIMEOUT);									// if count is more than the time out value, post the timeout
+			timer_int_count = NULL;
+		}
+	}
+	if(sensing_timer_on == YES)
+	{
+		timer_count_1++;
+		if(timer_count_1 > sensing_freq_val)										// Upon completition of the sensing time
+		{
+			POST_EVENT(EVENT_SENSING_TICK);
+			timer_count_1 = NULL;													// Clear the timer count
+		}
+	}
+	if(P2OUT & BIT2)
+	{
+		minute_relay_on++;
+		if(CCR1 < DUTY_OFF)
+		{
+			minute_light += (DUTY_OFF - CCR1) >> METER_LIGHT_SHIFT;
+		}
+		if(relay_was_on == NO)
+		{
+			minute_relay_starts++;
+		}
+		relay_was_on = YES;
 	}
 	else
 	{
-		received_val[character_count] = received_char;								// Put all the characters in an array
-		IFG2 &= ~UCA0RXIFG;															// Clear the receive interrupt flag
-		character_count++;															// Increase the character count index
+		relay_was_on = NO;
 	}
-	if(character_count == UNITY && ping_flag == 0) {								// Start UART timer to receive BLE address
-		TA1CTL 	|= (TASSEL_2 + MC_2);													// Use clock at 8 MHz
-		TA1CCTL0 |= CCIE;
-		TA1CCR0 = 0xFFFF;
+	if(++minute_checkpoints >= minute_interval)								// A minute is over
+	{
+		POST_EVENT(EVENT_MINUTE);
+	}
+	if((commit_countdown != NULL) && (--commit_countdown == NULL))				// Idle period after the last setting command is over
+	{
+		POST_EVENT(EVENT_CONFIG_COMMIT);
+	}
+	if((ble_address_wait != NULL) && (--ble_address_wait == NULL))				// No BLE address reply in time
+	{
+		POST_EVENT(EVENT_BLE_ADDRESS);
+	}
+	if(pir_warm_up != NULL)
+	{
+		pir_warm_up--;
 	}
-	if(ping_flag == 1 && character_count == 4)										// If all 4 characters of BLE address are received then go to main program
+	if(supply_monitor == YES)
 	{
-		__bic_SR_register_on_exit(LPM0_bits);
+		SUPPLY_SAMPLE();
 	}
-	else if (character_count >= MAX_CHAR)											// If all 7 characters are received, then go to main program
+	if(pending_events != NULL)
 	{
-		__bic_SR_register_on_exit(LPM0_bits);
+		__bic_SR_register_on_exit(LPM3_bits);										// wake up MCU from sleep mode
 	}
 }
 
 /*********************************************************************************************************************************
- * Interrupt name			: Timer_A ()
- * Date         			: 21/6/2017
+ * Interrupt name			: Supply_sag()
+ * Date         			: 17/10/2026
  * Passing parameters 		: None
  * Returning parameters 	: None
  * Author 					: Suhas K V
- * Description 				: This interrupt service routine is invoked when the timer timeout happens. It will check whether the
- * 							  occupancy time out is over. If yes, wake up the CPU.
+ * Description 				: ADC10 has measured VCC for the supply monitor. A sample below SUPPLY_SAG_MV writes the energy meter
+ * 							  and the dirty settings at once. Further samples are ignored until one is back above
+ * 							  SUPPLY_RECOVERED_MV, so a slowly falling supply does not keep writing.
  **********************************************************************************************************************************/
-#pragma vector=TIMER0_A0_VECTOR
-__interrupt void Timer_A (void)
+#pragma vector=ADC10_VECTOR
+__interrupt void Supply_sag(void)
 {
-	timer_int_count++;																// increment timer entry count
-	if (timer_int_count >= max_timer_count)
+	unsigned int counts = ADC10MEM;
+
+	ADC10CTL0 &= ~ENC;
+	ADC10CTL0 = NULL;																// ADC10 and reference off until the next checkpoint
+	if((supply_low == NO) && (counts < SUPPLY_COUNTS(SUPPLY_SAG_MV)))
 	{
-		time_out_flag = YES;														// if count is more than the time out value, set the flag
- 		timer_int_count = NULL;
-		__bic_SR_register_on_exit(LPM0_bits);										// wake up MCU from sleep mode
+		supply_low = YES;
+		POST_EVENT(EVENT_CONFIG_COMMIT);
+		__bic_SR_register_on_exit(LPM3_bits);										// wake up MCU from sleep mode
+	}
+	else if((supply_low == YES) && (counts >= SUPPLY_COUNTS(SUPPLY_RECOVERED_MV)))
+	{
+		supply_low = NO;
 	}
 }
 
@@ -2158,25 +3986,29 @@ __interrupt void Timer_A (void)
  * Passing parameters 		: None
  * Returning parameters 	: None
  * Author 					: Suhas K V
- * Description 				: This interrupt service routine is invoked when there is UART command is received. It checks for the
- * 							  corrctness of UART data.
+ * Description 				: This interrupt service routine is invoked RX_GAP_TIMEOUT after the last UART character and then every
+ * 							  timer period. A partly received frame is dropped on the first entry. About a second after the last
+ * 							  command the repeated command filter is cleared and the timer interrupt is disabled.
  **********************************************************************************************************************************/
 #pragma vector=TIMER1_A0_VECTOR
 __interrupt void Timer_A2 (void)
 {
+	if(character_count != NULL)														// Line idle in the middle of a frame
+	{
+		rx_head = rx_frame_start;													// Drop the partial frame
+		character_count = NULL;														// Clear the character count
+	}
+	if((ping_flag == YES) && (ble_address_run_end() == YES))						// Line idle after the BLE address
+	{
+		__bic_SR_register_on_exit(LPM3_bits);
+	}
 	timer_count++;
-	if(timer_count > 122)																// If no character is received after 2s then clear the character count
+	if(timer_count > 122)
 	{
 		TA1CCTL0 &= ~CCIE;															// Clear the timer interrupt
 		timer_count = NULL;															// Clear the timer count
-		character_count = NULL;														// Clear the character count
 		command_index_match = 255;
-		for (i = 0; i<10 ; i++)
-		{
-			junk = UCA0RXBUF;
-		}
-		IFG2 &= ~UCA0RXIFG;
-		IE2 |= UCA0RXIE;
+		__bic_SR_register_on_exit(LPM3_bits);										// Let main sleep deeper
 	}
 }
 
@@ -2186,21 +4018,37 @@ __interrupt void Timer_A2 (void)
  * Passing parameters 		: None
  * Returning parameters 	: None
  * Author 					: Suhas K V
- * Description 				: This interrupt service routine is invoked when the timer timeout happens. It will check whether the
- * 							  sensing time is over. If yes, wake up the CPU.
+ * Description 				: CCR2 samples the PIR output during a debounce and reports motion once pir_confirm high samples, or
+ * 							  all of them if pir_confirm is larger, are seen within pir_window samples. The CPU is woken at the
+ * 							  end so that it can sleep deeper again.
  **********************************************************************************************************************************/
 #pragma vector=TIMER1_A1_VECTOR
 __interrupt void Timer_A1 (void)
 {
 	switch(TA1IV)
 	{
-	case 2:
-		timer_count_1++;
-		if(timer_count_1 > sensing_freq_val)										// Upon completition of 15 seconds
+	case 4:
+		if(P1IN & BIT5)
 		{
-			timer_flag = YES;														// Set the timer flag
-			timer_count_1 = NULL;													// Clear the timer count
-			__bic_SR_register_on_exit(LPM0_bits);
+			pir_high_count++;
+		}
+		pir_samples--;
+		if(pir_high_count >= PIR_CONFIRM_SAMPLES)									// Motion confirmed
+		{
+			pir_samples = NULL;
+			if(P1IE & BIT5)															// Sensor not disabled meanwhile
+			{
+				pir_motion();
+			}
+		}
+		if(pir_samples == NULL)
+		{
+			TA1CCTL2 &= ~CCIE;
+			__bic_SR_register_on_exit(LPM3_bits);
+		}
+		else
+		{
+			TA1CCR2 += PIR_SAMPLE_TICKS;
 		}
 		break;
 
@@ -2215,37 +4063,41 @@ __interrupt void Timer_A1 (void)
  * Passing parameters 		: None
  * Returning parameters 	: None
  * Author 					: Suhas K V
- * Description 				: This interrupt service routine is invoked when the occupancy is detected.
+ * Description 				: This interrupt service routine is invoked on a PIR edge. It only starts the sampling in Timer_A1, which
+ * 							  calls pir_motion() once the motion is confirmed. Edges during a running debounce are ignored.
  **********************************************************************************************************************************/
 #pragma vector=PORT1_VECTOR
 __interrupt void Port_1(void)
 {
-	__delay_cycles(8000000);														// 1 second debounce delay
+	if((P1IFG & BIT5) && (pir_samples == NULL) && (pir_warm_up == NULL))			// Motion edge after the warm-up, start a debounce
+	{
+		pir_samples = pir_window;
+		pir_high_count = NULL;
+		TA1CTL 	|= (TASSEL_2 + MC_2);												// Use clock at 8 MHz
+		TA1CCR2 = TA1R + PIR_SAMPLE_TICKS;
+		TA1CCTL2 = CCIE;
+		__bic_SR_register_on_exit(SCG1 + SCG0);										// Keep SMCLK on for Timer1 if woken from LPM3
+	}
+	P2IFG &= ~BIT0;
+	P1IFG &= ~BIT5;
+}
 
-	if (P1IFG & BIT5)																// if Motion detected
+/* Acts on a debounced PIR motion */
+void pir_motion()
+{
+	if(isOff == false)																// if load is not turned off manually
 	{
-		pir_count++;																// increment count
-		if (pir_count >= MAX_PIR_COUNT)												//check for spikes - false triggering
+		P2OUT |= BIT2;
+		if(pirOff == true)
 		{
-			if(isOff == false)														// if load is not turned off manually
-			{
-				P2OUT |= BIT2;
-				if(pirOff == true)
-				{
-					lis_on_send_flag = true;
-					pirOff = false;
-				}
-			}
-			/* Initialise occupancy sensor timer */
-			TA0CTL |= (TASSEL_2 + MC_1 + ID_3);										// Use clock at 1 MHz
-			TA0CCTL0 |= CCIE;														// Enable Occupancy sensor timer interrupt
-			TA0CCR0 = PWM_WIDTH;
-			timer_int_count = NULL;
-			pir_flag = YES;
-			pir_count = NULL;														// Clear counter
+			POST_EVENT(EVENT_MOTION);
+			pirOff = false;
 		}
 	}
-	P2IFG &= ~BIT0;
-	P1IFG &= ~BIT5;
-	__bic_SR_register_on_exit(LPM0_bits);											// Clear LPM0 on exit
+	if(occupancy_motions < OCCUPANCY_MOTIONS_MAX)
+	{
+		occupancy_motions++;
+	}
+	OCCUPANCY_TIMER_START();														// Restart the occupancy sensor time out
+	pir_flag = YES;
 }